@@ -21,23 +21,282 @@
 #include "webrtc/common.h"
 #include "webrtc/common_video/libyuv/include/webrtc_libyuv.h"
 #include "webrtc/modules/interface/module_common_types.h"
+#include "webrtc/system_wrappers/interface/critical_section_wrapper.h"
 #include "webrtc/system_wrappers/interface/trace.h"
 #include "webrtc/system_wrappers/interface/tick_util.h"
 #include "webrtc/system_wrappers/interface/trace_event.h"
 
 namespace webrtc {
 
+static CriticalSectionWrapper* encode_observer_lock_ =
+    CriticalSectionWrapper::CreateCriticalSection();
+static H264EncodeObserver* encode_observer_ = NULL;
+static int max_threads_ = 0;
+static int default_temporal_layers_ = 1;
+
+// The slices of a frame are encoded in parallel, each needs enough rows of
+// macroblocks to keep the compression efficient.
+static const int kMinPixelsPerThread = 320 * 180;
+static const int kMaxThreads = 8;
+static const int kMaxTemporalLayers = 3;
+
+// Loss recovery by long-term reference (LTR) instead of IDR, see RecoverByLtr.
+static const int kLtrRefNum = 1;
+static const int kMinLtrMarkPeriod = 30;  // in frames
+static const uint32_t kMaxLtrRecoveryLoss = 255 * 20 / 100;  // of 255
+static const int kMaxParsedHeaderBytes = 32;
+
+// Screen content is encoded only when pixels change, with a refresh of the
+// static screen at intervals for the receivers to see the stream alive.
+static const int kMaxScreenStaticMs = 1000;
+
+enum {
+  kNaluSlice  = 1,
+  kNaluIdr    = 5,
+  kNaluSps    = 7,
+};
+
+// Length of the leading start code (00 00 01 or 00 00 00 01), 0 if none.
+static int StartCodeLength(const uint8_t* buffer, int length) {
+  if (length >= 4 && buffer[0] == 0 && buffer[1] == 0 &&
+      buffer[2] == 0 && buffer[3] == 1) {
+    return 4;
+  }
+  if (length >= 3 && buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 1) {
+    return 3;
+  }
+  return 0;
+}
+
+// Reader of the bits in RBSP, e.g. exp-golomb coded fields of headers.
+class RbspBitReader {
+ public:
+  RbspBitReader(const uint8_t* data, int length)
+      : data_(data), bits_(length * 8), pos_(0) {}
+
+  bool ReadBits(int count, uint32_t* value) {
+    *value = 0;
+    while (count-- > 0) {
+      if (pos_ >= bits_) {
+        return false;
+      }
+      *value = (*value << 1) | ((data_[pos_ >> 3] >> (7 - (pos_ & 7))) & 1);
+      pos_++;
+    }
+    return true;
+  }
+
+  bool ReadUe(uint32_t* value) {
+    int zeros = 0;
+    uint32_t bit = 0;
+    while (ReadBits(1, &bit) && bit == 0) {
+      if (++zeros > 31) {
+        return false;
+      }
+    }
+    uint32_t suffix = 0;
+    if (bit == 0 || !ReadBits(zeros, &suffix)) {
+      return false;
+    }
+    *value = (1u << zeros) - 1 + suffix;
+    return true;
+  }
+
+ private:
+  const uint8_t* data_;
+  int bits_;
+  int pos_;
+};
+
+// Copy the head of NAL payload (after the NAL header) without the emulation
+// prevention bytes, enough for the fields before slice data.
+static int UnescapeHeader(const uint8_t* nal, int length, uint8_t* rbsp) {
+  int size = 0;
+  int zeros = 0;
+  for (int k = 1; k < length && size < kMaxParsedHeaderBytes; k++) {
+    if (zeros >= 2 && nal[k] == 3) {
+      zeros = 0;
+      continue;
+    }
+    zeros = (nal[k] == 0) ? zeros + 1 : 0;
+    rbsp[size++] = nal[k];
+  }
+  return size;
+}
+
+// log2_max_frame_num of SPS.
+static bool ParseSps(const uint8_t* nal, int length, int* log2_max_frame_num) {
+  uint8_t rbsp[kMaxParsedHeaderBytes];
+  RbspBitReader reader(rbsp, UnescapeHeader(nal, length, rbsp));
+  uint32_t profile_idc = 0;
+  uint32_t value = 0;
+  if (!reader.ReadBits(8, &profile_idc) ||
+      !reader.ReadBits(16, &value) ||  // constraint flags and level_idc
+      !reader.ReadUe(&value)) {        // seq_parameter_set_id
+    return false;
+  }
+  if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 ||
+      profile_idc == 244 || profile_idc == 44 || profile_idc == 83 ||
+      profile_idc == 86 || profile_idc == 118 || profile_idc == 128) {
+    uint32_t chroma_format_idc = 0;
+    if (!reader.ReadUe(&chroma_format_idc) ||
+        (chroma_format_idc == 3 && !reader.ReadBits(1, &value)) ||
+        !reader.ReadUe(&value) ||  // bit_depth_luma_minus8
+        !reader.ReadUe(&value) ||  // bit_depth_chroma_minus8
+        !reader.ReadBits(1, &value) ||
+        !reader.ReadBits(1, &value) || value != 0) {
+      // scaling matrices are not written by openh264
+      return false;
+    }
+  }
+  if (!reader.ReadUe(&value)) {
+    return false;
+  }
+  *log2_max_frame_num = value + 4;
+  return true;
+}
+
+// frame_num and idr_pic_id (of IDR only) in the slice header.
+static bool ParseSliceHeader(const uint8_t* nal, int length,
+                             int log2_max_frame_num,
+                             int* frame_num, int* idr_pic_id) {
+  uint8_t rbsp[kMaxParsedHeaderBytes];
+  RbspBitReader reader(rbsp, UnescapeHeader(nal, length, rbsp));
+  uint32_t first_mb = 0;
+  uint32_t value = 0;
+  if (!reader.ReadUe(&first_mb) || first_mb != 0 ||
+      !reader.ReadUe(&value) ||  // slice_type
+      !reader.ReadUe(&value) ||  // pic_parameter_set_id
+      !reader.ReadBits(log2_max_frame_num, &value)) {
+    return false;
+  }
+  *frame_num = value;
+  if ((nal[0] & 0x1F) == kNaluIdr) {
+    if (!reader.ReadUe(&value)) {
+      return false;
+    }
+    *idr_pic_id = value;
+  }
+  return true;
+}
+
 H264Encoder* H264Encoder::Create() {
   return new H264EncoderImpl();
 }
 
+void H264Encoder::SetEncodeObserver(H264EncodeObserver* observer) {
+  CriticalSectionScoped cs(encode_observer_lock_);
+  encode_observer_ = observer;
+}
+
+void H264Encoder::SetMaxThreads(int max_threads) {
+  CriticalSectionScoped cs(encode_observer_lock_);
+  max_threads_ = (max_threads > 0) ? max_threads : 0;
+}
+
+void H264Encoder::SetTemporalLayers(int layers) {
+  CriticalSectionScoped cs(encode_observer_lock_);
+  if (layers < 1) {
+    layers = 1;
+  } else if (layers > kMaxTemporalLayers) {
+    layers = kMaxTemporalLayers;
+  }
+  default_temporal_layers_ = layers;
+}
+
+static int GetTemporalLayers() {
+  CriticalSectionScoped cs(encode_observer_lock_);
+  return default_temporal_layers_;
+}
+
+static inline uint64_t HashWord(uint64_t hash, uint64_t word) {
+  hash = (hash ^ word) * 1099511628211ULL;
+  return hash ^ (hash >> 32);
+}
+
+// A hash of the size and pixels, to tell an unchanged screen without keeping
+// a copy of the last frame. Each step is a bijection of the hash, so a
+// change within one word always changes the result.
+static uint64_t HashFrame(const I420VideoFrame& frame) {
+  uint64_t hash = 14695981039346656037ULL;
+  hash = HashWord(hash, (static_cast<uint64_t>(frame.width()) << 32) | frame.height());
+  for (int plane = kYPlane; plane < kNumOfPlanes; plane++) {
+    PlaneType type = static_cast<PlaneType>(plane);
+    int width = (type == kYPlane) ? frame.width() : (frame.width() + 1) / 2;
+    int height = (type == kYPlane) ? frame.height() : (frame.height() + 1) / 2;
+    const uint8_t* row = frame.buffer(type);
+    for (int y = 0; y < height; y++) {
+      int x = 0;
+      for (; x + 8 <= width; x += 8) {
+        uint64_t word;
+        memcpy(&word, row + x, sizeof(word));
+        hash = HashWord(hash, word);
+      }
+      for (; x < width; x++) {
+        hash = HashWord(hash, row[x]);
+      }
+      row += frame.stride(type);
+    }
+  }
+  return hash;
+}
+
+// Number of encoding threads (and slices) by the cores, resolution and cap.
+static int GetEncodeThreads(int number_of_cores, int width, int height) {
+  int threads = number_of_cores;
+  {
+    CriticalSectionScoped cs(encode_observer_lock_);
+    if (max_threads_ > 0 && threads > max_threads_) {
+      threads = max_threads_;
+    }
+  }
+  int max_by_size = (width * height) / kMinPixelsPerThread;
+  if (threads > max_by_size) {
+    threads = max_by_size;
+  }
+  if (threads > kMaxThreads) {
+    threads = kMaxThreads;
+  }
+  return (threads > 1) ? threads : 1;
+}
+
+static void NotifyFrameEncoded(const I420VideoFrame& input_image) {
+  CriticalSectionScoped cs(encode_observer_lock_);
+  if (encode_observer_ == NULL || input_image.render_time_ms() <= 0) {
+    return;
+  }
+  int64_t now_ms = TickTime::MillisecondTimestamp();
+  encode_observer_->OnFrameEncoded(input_image.width(), input_image.height(),
+                                   input_image.render_time_ms(),
+                                   static_cast<int>(now_ms - input_image.render_time_ms()));
+}
+
 H264EncoderImpl::H264EncoderImpl()
     : encoded_image_(),
+      fragmentation_(),
       encoded_complete_callback_(NULL),
       inited_(false),
       first_frame_encoded_(false),
       timestamp_(0),
-      encoder_(NULL) {
+      encoder_(NULL),
+      bitstream_copy_(NULL),
+      bitstream_copy_size_(0),
+      packet_loss_(0),
+      rtt_ms_(0),
+      ltr_mark_period_(kMinLtrMarkPeriod),
+      log2_max_frame_num_(0),
+      frame_num_(0),
+      idr_pic_id_(-1),
+      frames_since_idr_(0),
+      frames_since_ltr_recovery_(-1),
+      clean_frame_num_(-1),
+      loss_reported_(false),
+      temporal_layers_(1),
+      tl0_pic_idx_(0),
+      layers_since_base_(0),
+      screen_content_(false),
+      last_input_hash_(0),
+      last_encoded_ms_(0) {
   memset(&codec_, 0, sizeof(codec_));
   uint32_t seed = static_cast<uint32_t>(TickTime::MillisecondTimestamp());
   srand(seed);
@@ -48,9 +307,13 @@ H264EncoderImpl::~H264EncoderImpl() {
 }
 
 int H264EncoderImpl::Release() {
-  if (encoded_image_._buffer != NULL) {
-    delete [] encoded_image_._buffer;
-    encoded_image_._buffer = NULL;
+  // The encoded image only references the bitstream.
+  encoded_image_._buffer = NULL;
+  encoded_image_._size = 0;
+  if (bitstream_copy_ != NULL) {
+    delete [] bitstream_copy_;
+    bitstream_copy_ = NULL;
+    bitstream_copy_size_ = 0;
   }
   if (encoder_ != NULL) {
     DestroySVCEncoder(encoder_);
@@ -74,6 +337,13 @@ int H264EncoderImpl::SetRates(uint32_t new_bitrate_kbit,
   if (codec_.maxBitrate > 0 && new_bitrate_kbit > codec_.maxBitrate) {
     new_bitrate_kbit = codec_.maxBitrate;
   }
+  SBitrateInfo bitrate;
+  memset(&bitrate, 0, sizeof(SBitrateInfo));
+  bitrate.iLayer = SPATIAL_LAYER_ALL;
+  bitrate.iBitrate = new_bitrate_kbit * 1000;
+  encoder_->SetOption(ENCODER_OPTION_BITRATE, &bitrate);
+  float frame_rate = static_cast<float>(new_framerate);
+  encoder_->SetOption(ENCODER_OPTION_FRAME_RATE, &frame_rate);
 
   return WEBRTC_VIDEO_CODEC_OK;
 }
@@ -111,16 +381,57 @@ int H264EncoderImpl::InitEncode(const VideoCodec* inst,
       return WEBRTC_VIDEO_CODEC_ERROR;
     }
   }
-  SEncParamBase param;
-  memset (&param, 0, sizeof(SEncParamBase));
+  int threads = GetEncodeThreads(number_of_cores, inst->width, inst->height);
+  SEncParamExt param;
+  memset (&param, 0, sizeof(SEncParamExt));
+  encoder_->GetDefaultParams(&param);
 
   param.fMaxFrameRate = inst->maxFramerate;
   param.iPicWidth = inst->width;
   param.iPicHeight = inst->height;
-  param.iTargetBitrate = inst->maxBitrate;
+  // in bps
+  uint32_t start_bitrate = (inst->startBitrate > 0) ? inst->startBitrate : inst->maxBitrate;
+  param.iTargetBitrate = start_bitrate * 1000;
   param.iInputCsp = videoFormatI420;
+  // Screen content: variable frame rate by skipping, i.e. the rate control
+  // drops frames under a burst of changes, and static regions take no bits.
+  // High QP is tolerated as it is: openh264's default iMaxQp is already 51,
+  // the highest, so no bound is raised here.
+  screen_content_ = (inst->mode == kScreensharing);
+  if (screen_content_) {
+    param.iUsageType = SCREEN_CONTENT_REAL_TIME;
+    param.bEnableFrameSkip = true;
+    param.bEnableSceneChangeDetect = true;
+    param.bEnableBackgroundDetection = true;
+  } else {
+    param.iUsageType = CAMERA_VIDEO_REAL_TIME;
+  }
+  // One slice per thread, which are encoded in parallel.
+  param.iMultipleThreadIdc = threads;
+  // Temporal layers, whose temporal_id is in the prefix NAL of each slice
+  // for forwarders, and in CodecSpecificInfo for the sender. The prefix NAL
+  // is a packet of its own in the access unit, which only the marker bit of
+  // the last packet ends on receive.
+  temporal_layers_ = GetTemporalLayers();
+  param.iTemporalLayerNum = temporal_layers_;
+  param.bPrefixNalAddingCtrl = (temporal_layers_ > 1);
+  param.iSpatialLayerNum = 1;
+  param.sSpatialLayers[0].iVideoWidth = inst->width;
+  param.sSpatialLayers[0].iVideoHeight = inst->height;
+  param.sSpatialLayers[0].fFrameRate = inst->maxFramerate;
+  param.sSpatialLayers[0].iSpatialBitrate = start_bitrate * 1000;
+  // Recover from loss by referring to LTR rather than IDR.
+  param.bEnableLongTermReference = true;
+  param.iLTRRefNum = kLtrRefNum;
+  param.iLtrMarkPeriod = ltr_mark_period_;
+  if (threads > 1) {
+    param.sSpatialLayers[0].sSliceCfg.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+    param.sSpatialLayers[0].sSliceCfg.sSliceArgument.uiSliceNum = threads;
+  } else {
+    param.sSpatialLayers[0].sSliceCfg.uiSliceMode = SM_SINGLE_SLICE;
+  }
 
-  ret_val =  encoder_->Initialize(&param);
+  ret_val =  encoder_->InitializeExt(&param);
   if (ret_val != 0) {
     WEBRTC_TRACE(webrtc::kTraceError, webrtc::kTraceVideoCoding, -1,
                  "H264EncoderImpl::InitEncode() fails to initialize encoder ret_val %d",
@@ -130,22 +441,28 @@ int H264EncoderImpl::InitEncode(const VideoCodec* inst,
     return WEBRTC_VIDEO_CODEC_ERROR;
   }
   timestamp_ = 0;
+  log2_max_frame_num_ = 0;
+  frame_num_ = 0;
+  idr_pic_id_ = -1;
+  frames_since_idr_ = 0;
+  frames_since_ltr_recovery_ = -1;
+  clean_frame_num_ = -1;
+  loss_reported_ = false;
+  tl0_pic_idx_ = 0;
+  layers_since_base_ = 0;
+  last_input_hash_ = 0;
+  last_encoded_ms_ = 0;
 
   if (&codec_ != inst) {
     codec_ = *inst;
   }
 
-  if (encoded_image_._buffer != NULL) {
-    delete [] encoded_image_._buffer;
-  }
-  encoded_image_._size = CalcBufferSize(kI420, codec_.width, codec_.height);
-  encoded_image_._buffer = new uint8_t[encoded_image_._size];
   encoded_image_._completeFrame = true;
 
   inited_ = true;
   WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
-               "H264EncoderImpl::InitEncode(width:%d, height:%d, framerate:%d, start_bitrate:%d, max_bitrate:%d)",
-               inst->width, inst->height, inst->maxFramerate, inst->startBitrate, inst->maxBitrate);
+               "H264EncoderImpl::InitEncode(width:%d, height:%d, framerate:%d, start_bitrate:%d, max_bitrate:%d, threads:%d, screen:%d)",
+               inst->width, inst->height, inst->maxFramerate, inst->startBitrate, inst->maxBitrate, threads, screen_content_);
 
   return WEBRTC_VIDEO_CODEC_OK;
 }
@@ -170,12 +487,28 @@ int H264EncoderImpl::Encode(const I420VideoFrame& input_image,
   }
 
   bool send_keyframe = (frame_type == kKeyFrame);
-  if (send_keyframe) {
+  // No bits nor cpu for an unchanged screen, except the refresh at intervals.
+  int64_t now_ms = TickTime::MillisecondTimestamp();
+  uint64_t input_hash = screen_content_ ? HashFrame(input_image) : 0;
+  if (screen_content_ && !send_keyframe &&
+      now_ms - last_encoded_ms_ < kMaxScreenStaticMs &&
+      input_hash == last_input_hash_) {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  if (send_keyframe && RecoverByLtr()) {
+    frame_type = kDeltaFrame;
+    WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
+                 "H264EncoderImpl::RecoverByLtr(idr_pic_id:%d, loss:%d, rtt:%d)",
+                 idr_pic_id_, packet_loss_, rtt_ms_);
+  } else if (send_keyframe) {
     encoder_->ForceIntraFrame(true);
     WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
                  "H264EncoderImpl::EncodeKeyFrame(width:%d, height:%d)",
                  input_image.width(), input_image.height());
   }
+  if (send_keyframe) {
+    loss_reported_ = false;
+  }
   // Check for change in frame size.
   if (input_image.width() != codec_.width ||
       input_image.height() != codec_.height) {
@@ -206,49 +539,120 @@ int H264EncoderImpl::Encode(const I420VideoFrame& input_image,
   if (retVal == videoFrameTypeSkip) {
     return WEBRTC_VIDEO_CODEC_OK;
   }
+  if (screen_content_) {
+    last_input_hash_ = input_hash;
+    last_encoded_ms_ = now_ms;
+  }
 
-  int layer = 0;
-  //uint8_t* pbuff = encoded_image_._buffer;
-  while (layer < info.iLayerNum) {
+  if (retVal == videoFrameTypeIDR) {
+    frame_type = kKeyFrame;
+    frames_since_idr_ = 0;
+    frames_since_ltr_recovery_ = -1;
+    clean_frame_num_ = -1;
+  } else {
+    frames_since_idr_++;
+    if (frames_since_ltr_recovery_ >= 0) {
+      frames_since_ltr_recovery_++;
+    }
+  }
+
+  // One encoded image for the whole access unit, which references the
+  // bitstream of the encoder (valid until the next EncodeFrame) and lists its
+  // NAL units without start code by the fragmentation header. The layers are
+  // written one after another, or else copied together.
+  const uint8_t* bitstream = NULL;
+  uint32_t bitstream_size = 0;
+  bool contiguous = true;
+  int nalu_count = 0;
+  int temporal_idx = 0;
+  for (int layer = 0; layer < info.iLayerNum; layer++) {
     const SLayerBSInfo* layer_bs_info = &info.sLayerInfo[layer];
-    if (layer_bs_info != NULL) {
-      int layer_size = 0;
-      //int nal_begin = 0;
-      int nal_begin  = 4;
-      uint8_t* nal_buffer = NULL;
-      char nal_type = 0;
+    uint32_t layer_size = 0;
+    for (int nal_index = 0; nal_index < layer_bs_info->iNalCount; nal_index++) {
+      layer_size += layer_bs_info->iNalLengthInByte[nal_index];
+    }
+    if (layer_size == 0) {
+      continue;
+    }
+    if (bitstream == NULL) {
+      bitstream = layer_bs_info->pBsBuf;
+      temporal_idx = layer_bs_info->uiTemporalId;
+    } else if (layer_bs_info->pBsBuf != bitstream + bitstream_size) {
+      contiguous = false;
+    }
+    bitstream_size += layer_size;
+    nalu_count += layer_bs_info->iNalCount;
+  }
+  if (nalu_count == 0) {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  if (!contiguous) {
+    if (bitstream_size > bitstream_copy_size_) {
+      delete [] bitstream_copy_;
+      bitstream_copy_size_ = bitstream_size;
+      bitstream_copy_ = new uint8_t[bitstream_copy_size_];
+    }
+    uint32_t copied = 0;
+    for (int layer = 0; layer < info.iLayerNum; layer++) {
+      const SLayerBSInfo* layer_bs_info = &info.sLayerInfo[layer];
+      uint32_t layer_size = 0;
       for (int nal_index = 0; nal_index < layer_bs_info->iNalCount; nal_index++) {
-        nal_buffer  = layer_bs_info->pBsBuf + nal_begin;
-        nal_type    = (nal_buffer[0] & 0x1F);
-        //nal_type    = (nal_buffer[4] & 0x1F);
         layer_size += layer_bs_info->iNalLengthInByte[nal_index];
-        nal_begin  += layer_size;
-        if (nal_type == 14) {
-          continue;
-        }
-        encoded_image_._length          = layer_bs_info->iNalLengthInByte[nal_index] - 4;
-        //encoded_image_._length        = layer_bs_info->iNalLengthInByte[nal_index];
-        encoded_image_._frameType       = frame_type;
-        encoded_image_._timeStamp       = input_image.timestamp();
-        encoded_image_.capture_time_ms_ = input_image.render_time_ms();
-        memcpy(encoded_image_._buffer, nal_buffer, encoded_image_._length);
-        // encoded_image_._encodedHeight
-        // encoded_image_._encodedWidth
-
-        WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
-                     "H264EncoderImpl::Encode() nal_type %d, length:%d",
-                     nal_type, encoded_image_._length);
-
-        // call back
-        encoded_complete_callback_->Encoded(encoded_image_, NULL, NULL);
-
-        if (!first_frame_encoded_) {
-          first_frame_encoded_ = true;
-        }
-      } // for
+      }
+      memcpy(bitstream_copy_ + copied, layer_bs_info->pBsBuf, layer_size);
+      copied += layer_size;
+    }
+    bitstream = bitstream_copy_;
+  }
+  fragmentation_.VerifyAndAllocateFragmentationHeader(nalu_count);
+
+  uint32_t position = 0;
+  int nalu_index = 0;
+  for (int layer = 0; layer < info.iLayerNum; layer++) {
+    const SLayerBSInfo* layer_bs_info = &info.sLayerInfo[layer];
+    for (int nal_index = 0; nal_index < layer_bs_info->iNalCount; nal_index++) {
+      const uint8_t* nal_buffer = bitstream + position;
+      int nal_length = layer_bs_info->iNalLengthInByte[nal_index];
+      int start_code = StartCodeLength(nal_buffer, nal_length);
+      int payload_length = nal_length - start_code;
+      position += nal_length;
+      if (payload_length <= 0) {
+        continue;
+      }
+      ParseNalu(nal_buffer + start_code, payload_length);
+      fragmentation_.fragmentationOffset[nalu_index] = position - payload_length;
+      fragmentation_.fragmentationLength[nalu_index] = payload_length;
+      fragmentation_.fragmentationPlType[nalu_index] = 0;
+      fragmentation_.fragmentationTimeDiff[nalu_index] = 0;
+      nalu_index++;
     }
-    layer++;
   }
+  if (nalu_index == 0) {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  fragmentation_.fragmentationVectorSize = nalu_index;
+
+  encoded_image_._buffer          = const_cast<uint8_t*>(bitstream);
+  encoded_image_._size            = bitstream_size;
+  encoded_image_._length          = bitstream_size;
+  encoded_image_._frameType       = frame_type;
+  encoded_image_._timeStamp       = input_image.timestamp();
+  encoded_image_.capture_time_ms_ = input_image.render_time_ms();
+  encoded_image_._encodedWidth    = codec_.width;
+  encoded_image_._encodedHeight   = codec_.height;
+
+  WEBRTC_TRACE(webrtc::kTraceApiCall, webrtc::kTraceVideoCoding, -1,
+               "H264EncoderImpl::Encode() frame_type %d, nalus:%d, length:%d",
+               frame_type, nalu_index, bitstream_size);
+
+  // call back
+  CodecSpecificInfo codec_specific;
+  PopulateCodecSpecific(&codec_specific, temporal_idx);
+  encoded_complete_callback_->Encoded(encoded_image_, &codec_specific, &fragmentation_);
+  if (!first_frame_encoded_) {
+    first_frame_encoded_ = true;
+  }
+  NotifyFrameEncoded(input_image);
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
@@ -258,11 +662,96 @@ int H264EncoderImpl::RegisterEncodeCompleteCallback(
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
-int H264EncoderImpl::SetChannelParameters(uint32_t /*packet_loss*/, int rtt) {
-  // ffs
+int H264EncoderImpl::SetChannelParameters(uint32_t packet_loss, int rtt) {
+  packet_loss_ = packet_loss;
+  rtt_ms_ = rtt;
+  // The frames encoded so far are taken as received, when the receiver
+  // reports no loss.
+  if (packet_loss > 0) {
+    loss_reported_ = true;
+  } else if (idr_pic_id_ >= 0) {
+    clean_frame_num_ = frame_num_;
+  }
+  if (!inited_) {
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  // Mark LTR at least two round trips apart, so that the last one has
+  // likely reached the receiver when it is referred to for recovery.
+  int period = 2 * rtt * static_cast<int>(codec_.maxFramerate) / 1000;
+  if (period < kMinLtrMarkPeriod) {
+    period = kMinLtrMarkPeriod;
+  }
+  if (period != ltr_mark_period_) {
+    ltr_mark_period_ = period;
+    encoder_->SetOption(ENCODER_LTR_MARKING_PERIOD, &period);
+  }
   return WEBRTC_VIDEO_CODEC_OK;
 }
 
+bool H264EncoderImpl::RecoverByLtr() {
+  // No LTR is marked since the last IDR yet.
+  if (idr_pic_id_ < 0 || frames_since_idr_ <= ltr_mark_period_) {
+    return false;
+  }
+  // Under heavy loss the LTR is likely lost as well.
+  if (packet_loss_ > kMaxLtrRecoveryLoss) {
+    return false;
+  }
+  // Without loss reported since the last request, the receiver may have no
+  // LTR at all (e.g. a new joiner or a decoder reset).
+  if (!loss_reported_ || clean_frame_num_ < 0) {
+    return false;
+  }
+  // Once recovered, the next request is by IDR until a new LTR is marked,
+  // i.e. the last recovery may have failed.
+  if (frames_since_ltr_recovery_ >= 0 &&
+      frames_since_ltr_recovery_ <= ltr_mark_period_) {
+    return false;
+  }
+
+  // The current frame is lost, openh264 encodes the next frame by referring
+  // to LTR, or IDR if none is available. The receiver's last decoded frame
+  // is not in PLI, so it is the last one before a report without loss.
+  SLTRRecoverRequest request;
+  memset(&request, 0, sizeof(SLTRRecoverRequest));
+  request.uiFeedbackType = LTR_RECOVERY_REQUEST;
+  request.uiIDRPicId = idr_pic_id_;
+  request.iLastCorrectFrameNum = clean_frame_num_;
+  request.iCurrentFrameNum = -1;
+  if (encoder_->SetOption(ENCODER_LTR_RECOVERY_REQUEST, &request) != 0) {
+    return false;
+  }
+  frames_since_ltr_recovery_ = 0;
+  return true;
+}
+
+void H264EncoderImpl::PopulateCodecSpecific(CodecSpecificInfo* codec_specific,
+                                            int temporal_idx) {
+  memset(codec_specific, 0, sizeof(CodecSpecificInfo));
+  codec_specific->codecType = kVideoCodecH264;
+  CodecSpecificInfoH264* h264 = &codec_specific->codecSpecific.H264;
+  if (temporal_idx == 0) {
+    tl0_pic_idx_++;
+    layers_since_base_ = 0;
+  }
+  // A frame of layer T is sync if it only refers to the base layer, i.e. no
+  // frame of layer 1..T is encoded since the last base layer frame.
+  uint32_t lower_layers = ((1u << (temporal_idx + 1)) - 1) & ~1u;
+  h264->temporal_idx = static_cast<uint8_t>(temporal_idx);
+  h264->layer_sync = (temporal_idx > 0) && (layers_since_base_ & lower_layers) == 0;
+  h264->tl0_pic_idx = tl0_pic_idx_;
+  layers_since_base_ |= (1u << temporal_idx);
+}
+
+void H264EncoderImpl::ParseNalu(const uint8_t* nal, int length) {
+  int nal_type = nal[0] & 0x1F;
+  if (nal_type == kNaluSps) {
+    ParseSps(nal, length, &log2_max_frame_num_);
+  } else if ((nal_type == kNaluSlice || nal_type == kNaluIdr) && log2_max_frame_num_ > 0) {
+    ParseSliceHeader(nal, length, log2_max_frame_num_, &frame_num_, &idr_pic_id_);
+  }
+}
+
 int H264EncoderImpl::UpdateCodecFrameSize(const I420VideoFrame& input_image) {
   codec_.width = input_image.width();
   codec_.height = input_image.height();
@@ -281,9 +770,10 @@ H264DecoderImpl::H264DecoderImpl()
       decoder_(NULL),
       last_keyframe_(),
       key_frame_required_(true),
-      buffer_with_start_code_(NULL) {
+      buffer_with_start_code_(NULL),
+      buffer_size_(MAX_ENCODED_IMAGE_SIZE) {
   memset(&codec_, 0, sizeof(codec_));
-  buffer_with_start_code_ = new unsigned char [MAX_ENCODED_IMAGE_SIZE];
+  buffer_with_start_code_ = new unsigned char [buffer_size_];
 }
 
 H264DecoderImpl::~H264DecoderImpl() {
@@ -405,9 +895,17 @@ int H264DecoderImpl::Decode(const EncodedImage& input_image,
   memset(&buffer_info, 0, sizeof(SBufferInfo));
 
   unsigned char start_code[] = {0, 0, 0, 1};
-  memset(buffer_with_start_code_, 0, MAX_ENCODED_IMAGE_SIZE);
+  if (input_image._length + 5 > buffer_size_) {
+    delete [] buffer_with_start_code_;
+    buffer_size_ = input_image._length + 5;
+    buffer_with_start_code_ = new unsigned char [buffer_size_];
+  }
   int encoded_image_size = 0;
-  if (single_nalu) {
+  if (StartCodeLength(input_image._buffer, input_image._length) > 0) {
+    // Annex B from the receiver, e.g. several slices of the frame
+    memcpy(buffer_with_start_code_, input_image._buffer, input_image._length);
+    encoded_image_size = input_image._length;
+  } else if (single_nalu) {
     memcpy(buffer_with_start_code_, start_code, 4);
     memcpy(buffer_with_start_code_ + 4, input_image._buffer, input_image._length);
     encoded_image_size = 4 + input_image._length;
@@ -101,17 +101,48 @@ class H264EncoderImpl : public H264Encoder {
   // Update frame size for codec.
   int UpdateCodecFrameSize(const I420VideoFrame& input_image);
 
-  //void PopulateCodecSpecific(CodecSpecificInfo* codec_specific,
-  //                           const vpx_codec_cx_pkt& pkt,
-  //                           uint32_t timestamp);
+  // Request openh264 to encode the next frame by referring to LTR instead of
+  // IDR for a key frame request, if loss is reported since the last request,
+  // the loss allows, and no recovery is made since the last LTR.
+  bool RecoverByLtr();
+
+  // Track frame_num and idr_pic_id of the encoded slices for LTR recovery.
+  void ParseNalu(const uint8_t* nal, int length);
+
+  // Fill the temporal layer of the encoded frame.
+  void PopulateCodecSpecific(CodecSpecificInfo* codec_specific,
+                             int temporal_idx);
 
   EncodedImage encoded_image_;
+  RTPFragmentationHeader fragmentation_;  // NAL units of encoded_image_
   EncodedImageCallback* encoded_complete_callback_;
   VideoCodec codec_;
   bool inited_;
   bool first_frame_encoded_;
   int64_t timestamp_;
   ISVCEncoder* encoder_;
+  // the layers copied together when not contiguous in the encoder
+  uint8_t* bitstream_copy_;
+  uint32_t bitstream_copy_size_;
+  // for loss recovery
+  uint32_t packet_loss_;  // fraction of 255
+  int rtt_ms_;
+  int ltr_mark_period_;
+  int log2_max_frame_num_;
+  int frame_num_;
+  int idr_pic_id_;  // -1 before the first IDR
+  int frames_since_idr_;
+  int frames_since_ltr_recovery_;  // -1 if none since the last IDR
+  int clean_frame_num_;  // at the last report without loss, -1 if none since the last IDR
+  bool loss_reported_;  // since the last key frame request
+  // for temporal layers
+  int temporal_layers_;
+  uint8_t tl0_pic_idx_;
+  uint32_t layers_since_base_;  // bit per temporal_idx
+  // for screen content
+  bool screen_content_;
+  uint64_t last_input_hash_;  // of the last encoded, to skip unchanged frames
+  int64_t last_encoded_ms_;
 };  // end of H264Encoder class
 
 
@@ -191,6 +222,7 @@ class H264DecoderImpl : public H264Decoder {
   EncodedImage last_keyframe_;
   bool key_frame_required_;
   unsigned char* buffer_with_start_code_;
+  uint32_t buffer_size_;  // grown for the largest frame
 };  // end of H264Decoder class
 }  // namespace webrtc
 
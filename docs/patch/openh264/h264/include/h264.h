@@ -5,10 +5,40 @@
 
 namespace webrtc {
 
+// Observer of the encode time of each frame, e.g. for cpu overuse detection.
+class H264EncodeObserver {
+ public:
+  // Called on the encoding thread when a frame has been encoded.
+  //
+  //          - width, height   : Size of the encoded frame
+  //          - capture_time_ms : Capture time of the frame
+  //          - encode_time_ms  : Time from capture to encode complete
+  virtual void OnFrameEncoded(int width, int height,
+                              int64_t capture_time_ms,
+                              int encode_time_ms) = 0;
+
+ protected:
+  virtual ~H264EncodeObserver() {}
+};
+
+// The encoded image passed to EncodedImageCallback references the bitstream
+// of the encoder, which is valid until the next Encode(); a consumer copies
+// it to retain the data.
 class H264Encoder : public VideoEncoder {
  public:
   static H264Encoder* Create();
 
+  // Set the observer shared by all encoders, NULL to remove it.
+  static void SetEncodeObserver(H264EncodeObserver* observer);
+
+  // Cap the encoding threads of each encoder created afterwards, e.g. when
+  // many sessions share a host. 0 (default) means up to number_of_cores.
+  static void SetMaxThreads(int max_threads);
+
+  // Set the temporal layers (1 to 3) of each encoder created afterwards, and
+  // the layer of each frame is in CodecSpecificInfoH264. 1 by default.
+  static void SetTemporalLayers(int layers);
+
   virtual ~H264Encoder() {};
 };  // end of H264Encoder class
 
@@ -17,24 +17,23 @@ namespace webrtc {
 
 RtpFormatH264::RtpFormatH264(const uint8_t* payload_data,
                            uint32_t payload_size,
+                           const RTPFragmentationHeader* fragmentation,
                            int max_payload_len)
     : payload_data_(payload_data),
       payload_size_(static_cast<int>(payload_size)),
       max_payload_len_(static_cast<int>(max_payload_len)),
+      part_info_(),
+      next_nalu_(0),
       fragments_(0),
       fragment_size_(0),
-      next_fragment_(-1) {
-  if (payload_size_ <= max_payload_len_) {
-    fragments_ = 0;
+      next_fragment_(0) {
+  if (fragmentation != NULL && fragmentation->fragmentationVectorSize > 0) {
+    part_info_.CopyFrom(*fragmentation);
   } else {
-    fragment_size_ = max_payload_len_ - kH264FUAHeaderLengthInBytes;
-    fragments_     = (payload_size_ - kH264NALHeaderLengthInBytes)/ fragment_size_;
-    if (fragments_ * fragment_size_ != (payload_size_ - kH264NALHeaderLengthInBytes)) {
-      fragments_++;
-    }
-    next_fragment_ = 0;
+    part_info_.VerifyAndAllocateFragmentationHeader(1);
+    part_info_.fragmentationOffset[0] = 0;
+    part_info_.fragmentationLength[0] = payload_size;
   }
-
 }
 
 RtpFormatH264::~RtpFormatH264() {}
@@ -42,57 +41,79 @@ RtpFormatH264::~RtpFormatH264() {}
 int RtpFormatH264::NextPacket(uint8_t* buffer,
                              int* bytes_to_send,
                              bool* last_packet) {
-  if (next_fragment_ == fragments_) {
-    *bytes_to_send = 0;
-    *last_packet   = true;
+  *bytes_to_send = 0;
+  *last_packet   = true;
+  if (next_nalu_ >= part_info_.fragmentationVectorSize) {
     return -1;
   }
-  if (payload_size_ <= max_payload_len_) {
+  const int nalu_offset = static_cast<int>(part_info_.fragmentationOffset[next_nalu_]);
+  const int nalu_size   = static_cast<int>(part_info_.fragmentationLength[next_nalu_]);
+  if (nalu_size <= kH264NALHeaderLengthInBytes ||
+      nalu_offset + nalu_size > payload_size_) {
+    WEBRTC_TRACE(kTraceError, kTraceRtpRtcp, -1,
+                 "RtpFormatH264(invalid NALU %d, offset:%d, size:%d)",
+                 next_nalu_, nalu_offset, nalu_size);
+    return -1;
+  }
+  const uint8_t* nalu = payload_data_ + nalu_offset;
+  const bool last_nalu = (next_nalu_ == part_info_.fragmentationVectorSize - 1);
+
+  if (nalu_size <= max_payload_len_) {
     // single NAL_UNIT
-    *bytes_to_send = payload_size_;
-    *last_packet   = false;
-    memcpy(buffer, payload_data_, payload_size_);
+    *bytes_to_send = nalu_size;
+    *last_packet   = last_nalu;
+    memcpy(buffer, nalu, nalu_size);
     WEBRTC_TRACE(kTraceStream, kTraceRtpRtcp, -1,
                  "RtpFormatH264(single NALU with type:%d, payload_size:%d",
-                 payload_data_[0] & 0x1F, payload_size_);
+                 nalu[0] & 0x1F, nalu_size);
+    next_nalu_++;
     return 0;
-  } else {
-    unsigned char header = payload_data_[0];
-    unsigned char type   = header & 0x1F;
-    unsigned char fu_indicator;
-    fu_indicator = (header & 0xE0) | kH264FUANALUType;
-    unsigned char fu_header = 0;
-    bool first_fragment = (next_fragment_ == 0);
-    bool last_fragment = (next_fragment_ == (fragments_ -1));
+  }
 
+  if (next_fragment_ == 0) {
+    fragment_size_ = max_payload_len_ - kH264FUAHeaderLengthInBytes;
+    fragments_     = (nalu_size - kH264NALHeaderLengthInBytes) / fragment_size_;
+    if (fragments_ * fragment_size_ != (nalu_size - kH264NALHeaderLengthInBytes)) {
+      fragments_++;
+    }
+  }
 
-    //S | E | R | 5 bit type
-    fu_header |= (first_fragment ? 128 : 0); // S bit
-    fu_header |= (last_fragment ? 64 :0); // E bit
-    fu_header |= type;
-    buffer[0] = fu_indicator;
-    buffer[1] = fu_header;
+  unsigned char header = nalu[0];
+  unsigned char type   = header & 0x1F;
+  unsigned char fu_indicator;
+  fu_indicator = (header & 0xE0) | kH264FUANALUType;
+  unsigned char fu_header = 0;
+  bool first_fragment = (next_fragment_ == 0);
+  bool last_fragment = (next_fragment_ == (fragments_ -1));
 
-    if (last_fragment) {
-      // last fragment
-      *bytes_to_send = payload_size_ - kH264NALHeaderLengthInBytes - next_fragment_ * fragment_size_ + kH264FUAHeaderLengthInBytes;
-      *last_packet   = true;
-      memcpy(buffer + kH264FUAHeaderLengthInBytes,
-             payload_data_ + kH264NALHeaderLengthInBytes + next_fragment_ * fragment_size_,
-             *bytes_to_send - kH264FUAHeaderLengthInBytes); // We do not send original NALU header
-    } else {
-      *bytes_to_send = fragment_size_ + kH264FUAHeaderLengthInBytes;
-      *last_packet   = false;
-      memcpy(buffer + kH264FUAHeaderLengthInBytes,
-             payload_data_ + kH264NALHeaderLengthInBytes + next_fragment_ * fragment_size_,
-             fragment_size_); // We do not send original NALU header
-    }
-      WEBRTC_TRACE(kTraceStream, kTraceRtpRtcp, -1,
-                   "RtpFormatH264(Frag/Frags: %d/%d, NALU with type:%d, payload_size:%d",
-                   next_fragment_, fragments_, payload_data_[0] & 0x1F, *bytes_to_send - 2);
-      next_fragment_++;
-      return 1;
+  //S | E | R | 5 bit type
+  fu_header |= (first_fragment ? 128 : 0); // S bit
+  fu_header |= (last_fragment ? 64 :0); // E bit
+  fu_header |= type;
+  buffer[0] = fu_indicator;
+  buffer[1] = fu_header;
+
+  int fragment_length = fragment_size_;
+  if (last_fragment) {
+    fragment_length = nalu_size - kH264NALHeaderLengthInBytes - next_fragment_ * fragment_size_;
+  }
+  // We do not send original NALU header
+  memcpy(buffer + kH264FUAHeaderLengthInBytes,
+         nalu + kH264NALHeaderLengthInBytes + next_fragment_ * fragment_size_,
+         fragment_length);
+  *bytes_to_send = fragment_length + kH264FUAHeaderLengthInBytes;
+  *last_packet   = last_nalu && last_fragment;
+  WEBRTC_TRACE(kTraceStream, kTraceRtpRtcp, -1,
+               "RtpFormatH264(Frag/Frags: %d/%d, NALU with type:%d, payload_size:%d",
+               next_fragment_, fragments_, type, fragment_length);
+
+  next_fragment_++;
+  if (last_fragment) {
+    next_fragment_ = 0;
+    fragments_     = 0;
+    next_nalu_++;
   }
+  return 1;
 }
 
 }  // namespace webrtc
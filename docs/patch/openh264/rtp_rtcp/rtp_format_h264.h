@@ -11,11 +11,8 @@
 /*
  * This file contains the declaration of the H264 packetizer class.
  * A packetizer object is created for each encoded video frame. The
- * constructor is called with the payload data and size,
- * together with the fragmentation information and a packetizer mode
- * of choice. Alternatively, if no fragmentation info is available, the
- * second constructor can be used with only payload data and size; in that
- * case the mode kEqualSize is used.
+ * constructor is called with the payload data and size, together with
+ * the fragmentation information which lists the NAL units of the frame.
  *
  * After creating the packetizer, the method NextPacket is called
  * repeatedly to get all packets for the frame. The method returns
@@ -42,9 +39,12 @@ class RtpFormatH264 {
          kH264NALU_IDR               = 5};
 
   // Initialize with payload from encoder.
-  // The payload_data must be exactly one encoded H264 frame.
+  // The payload_data must be exactly one encoded H264 access unit, whose NAL
+  // units (without start code) are listed by fragmentation. If fragmentation
+  // is NULL, the whole payload is one NAL unit.
   RtpFormatH264(const uint8_t* payload_data,
                uint32_t payload_size,
+               const RTPFragmentationHeader* fragmentation,
                int max_payload_len);
 
   ~RtpFormatH264();
@@ -54,8 +54,9 @@ class RtpFormatH264 {
   // buffer is a pointer to where the output will be written.
   // bytes_to_send is an output variable that will contain number of bytes
   // written to buffer. Parameter last_packet is true for the last packet of
-  // the frame, false otherwise (i.e., call the function again to get the
-  // next packet).
+  // the access unit, false otherwise (i.e., call the function again to get
+  // the next packet). Each NAL unit is sent in a single packet or fragmented
+  // by FU-A.
   // Returns 0 on success for single NAL_UNIT
   // Returns 1 on success for fragmentation
   // return -1 on error.
@@ -67,7 +68,9 @@ class RtpFormatH264 {
   const uint8_t* payload_data_;
   const int payload_size_;
   const int max_payload_len_;
-  int   fragments_;
+  RTPFragmentationHeader part_info_;
+  int   next_nalu_;
+  int   fragments_;       // of the current NAL unit, 0 if not fragmented
   int   fragment_size_;
   int   next_fragment_;
   DISALLOW_COPY_AND_ASSIGN(RtpFormatH264);
@@ -49,6 +49,58 @@ typedef struct _ice_server {
 }ice_server_t;
 typedef std::vector<ice_server_t> ice_servers_t;
 
+// policy of bundling media on transports
+enum bundle_policy_t {
+    kBundlePolicyBalanced,      // offer bundle and gather for each media (default)
+    kBundlePolicyMaxCompat,     // not offer bundle
+    kBundlePolicyMaxBundle,     // gather for the first bundled media only, and require bundle
+};
+
+// policy of muxing rtp and rtcp
+enum rtcp_mux_policy_t {
+    kRtcpMuxPolicyNegotiate,    // gather for rtcp as well (default)
+    kRtcpMuxPolicyRequire,      // not gather for rtcp, and require rtcp-mux
+};
+
+// policy of ice candidates gathered
+enum ice_transport_policy_t {
+    kIceTransportAll,           // default
+    kIceTransportRelay,         // relay candidates only
+    kIceTransportNone,          // no candidate
+    kIceTransportHost,          // host candidates only, without stun/turn servers
+};
+
+// for ip family of networks gathered
+enum ip_policy_t {
+    kIpPolicyDefault,           // ipv4 only as libjingle (default)
+    kIpPolicyV4Only,
+    kIpPolicyV6Only,
+    kIpPolicyBoth,
+};
+
+// for networks ignored in gathering
+enum network_filter_t {
+    kNetworkIgnoreLoopback      = 0x01,
+    kNetworkIgnoreLinkLocal     = 0x02,     // 169.254.0.0/16 and fe80::/10
+    kNetworkIgnoreVpn           = 0x04,     // tun, tap, ppp, utun, ipsec
+    kNetworkIgnoreVirtual       = 0x08,     // vmnet, vboxnet, docker, veth, virbr
+};
+
+// for configuration of peer connection
+typedef struct _rtc_config {
+    int ice_candidate_pool_size;    // transports gathering candidates before the first local sdp, 0 to disable
+    int bundle_policy;              // refer to bundle_policy_t
+    int rtcp_mux_policy;            // refer to rtcp_mux_policy_t
+    int ice_transport_policy;       // refer to ice_transport_policy_t
+    int network_ignore;             // refer to network_filter_t, 0 for all networks
+    std::vector<std::string> network_allowlist;    // names of interfaces gathered, e.g. "eth0", empty for all
+    int ip_policy;                  // refer to ip_policy_t
+    
+    _rtc_config() : ice_candidate_pool_size(0), bundle_policy(kBundlePolicyBalanced), 
+        rtcp_mux_policy(kRtcpMuxPolicyNegotiate), ice_transport_policy(kIceTransportAll), network_ignore(0),
+        ip_policy(kIpPolicyDefault) {}
+}rtc_config_t;
+
 // state of ice connection
 enum ice_conn_state_t {
     kIceConnNew,
@@ -60,6 +112,12 @@ enum ice_conn_state_t {
     kIceConnClosed,
 };
 
+// format of sdp and candidate messages
+enum signaling_format_t {
+    kJsonSignaling,         // json text (default)
+    kBinarySignaling,       // compact binary, smaller and faster to parse
+};
+
 
 //>
 // colorspace of video frame 
@@ -196,6 +254,62 @@ typedef struct _media_constraints {
 }media_constraints_t;
 
 
+// for one step of cpu overuse adaptation
+typedef struct _adaptation_step {
+    int scale;              // percent of captured width and height, 100 for no scaling
+    int frameRate;          // max frame rate, 0 for the captured one
+    
+    _adaptation_step() : scale(100), frameRate(0) {}
+    _adaptation_step(int scale, int frameRate) : scale(scale), frameRate(frameRate) {}
+}adaptation_step_t;
+
+// for configuration of cpu overuse adaptation
+typedef struct _adaptation_config {
+    bool enabled;           // default true
+    int overuse_ms;         // step down when capture-to-encode time is above it
+    int underuse_ms;        // step up when capture-to-encode time is below it
+    int down_hold_ms;       // min interval before stepping down again
+    int up_hold_ms;         // min interval before stepping up, doubled if the step up overuses
+    std::vector<adaptation_step_t> ladder;  // from the best to the worst, empty for default
+    
+    _adaptation_config() : enabled(true), overuse_ms(85), underuse_ms(40), down_hold_ms(2000), up_hold_ms(10000) {}
+}adaptation_config_t;
+
+// for current state of cpu overuse adaptation
+typedef struct _adaptation_state {
+    bool available;         // false if no encode time (library built without the h264 hook)
+    int level;              // index of current step in ladder, 0 for the best
+    int levels;             // number of steps in ladder
+    int width;              // size of the last encoded frame
+    int height;
+    int frameRate;          // max frame rate of current step, 0 for the captured one
+    int encode_ms;          // smoothed capture-to-encode time
+    
+    _adaptation_state() : available(false), level(0), levels(0), width(0), height(0), frameRate(0), encode_ms(0) {}
+}adaptation_state_t;
+
+
+// for rtcp feedback of video codecs in sdp policy
+enum rtcp_feedback_t {
+    kRtcpFbNack         = 0x01,     // a=rtcp-fb:* nack
+    kRtcpFbNackPli      = 0x02,     // a=rtcp-fb:* nack pli
+    kRtcpFbCcmFir       = 0x04,     // a=rtcp-fb:* ccm fir
+    kRtcpFbRemb         = 0x08,     // a=rtcp-fb:* goog-remb
+};
+
+// for policy of local sdp, applied to offer/answer before IRtcSink::OnSessionDescription
+typedef struct _sdp_policy {
+    std::vector<std::string> audio_codecs;  // preferred order by codec name, e.g. "opus", the unlisted follow
+    std::vector<std::string> video_codecs;  // e.g. "H264", "VP8"
+    bool strip_unlisted;        // remove the unlisted codecs, except red/ulpfec and rtx of the listed
+    std::string h264_profile_level_id;      // e.g. "42e01f", empty to keep
+    int audio_bandwidth;        // b=AS in kbps, 0 to keep
+    int video_bandwidth;        // b=AS in kbps, 0 to keep
+    int video_rtcp_fb;          // refer to rtcp_feedback_t, -1 to keep
+    
+    _sdp_policy() : strip_unlisted(false), audio_bandwidth(0), video_bandwidth(0), video_rtcp_fb(-1) {}
+}sdp_policy_t;
+
 //>
 // The interface of video render
 #if defined(OBJC) // For OBJC intefaces
@@ -255,6 +369,15 @@ public:
 @required
 - (void) OnError;
 
+@optional
+- (void) OnDeviceChange:(int)kind;
+
+@optional
+- (void) OnSetLocalDescription:(int)error errstr:(std::string)str elapsed:(long)elapsed_us;
+
+@optional
+- (void) OnSetRemoteDescription:(int)error errstr:(std::string)str elapsed:(long)elapsed_us;
+
 @end
 typedef NSObject<IRtcSink> IRtcSink;
 
@@ -265,18 +388,20 @@ public:
     virtual ~IRtcSink() {}
 
     // Return media sdp of local a/v, which should be sent to remote peer
-    // @param sdp: [out] sdp of local a/v (json format)
+    // @param sdp: [out] sdp of local a/v (json format, or binary refer to IRtcCenter::SetSignalingFormat())
     virtual void OnSessionDescription(const std::string &sdp) = 0;
 
     // Return ice candidate of current peer connection, which should be sent to remote peer
-    // @param candidate: [out] ice candidate (json format)
+    // @param candidate: [out] ice candidate (json format), 
+    //      or a json array of candidates if IRtcCenter::SetCandidateBatching() enabled
     virtual void OnIceCandidate(const std::string &candidate) = 0;
 
     // Notify the status of remote stream(ADD or REMOVE)
     // @param action: [out] status of remote stream, refer to action_t
     virtual void OnRemoteStream(int action) = 0;
 
-    // This callback will be activated when IRtcCenter::GetUserMedia()
+    // This callback will be activated when IRtcCenter::GetUserMedia() completes,
+    //      which is called from a background thread.
     // @param error: [out] 0 if OK, else fail
     // @param errstr: [out] error message
     virtual void OnGetUserMedia(int error, std::string errstr) = 0;
@@ -291,6 +416,21 @@ public:
 
     // This callback will be activated when error happens in peer connection
     virtual void OnError() = 0;
+
+    // This optional callback will be activated when devices are plugged in or out
+    // @param kind: [out] kind of changed devices, refer to device_kind_t
+    virtual void OnDeviceChange(int kind) {}
+
+    // This callback will be activated when IRtcCenter::SetLocalDescription() completes,
+    //      which is called from the signaling thread, or at once if the sdp is invalid.
+    // @param error: [out] 0 if OK, else fail
+    // @param errstr: [out] error message
+    // @param elapsed_us: [out] microseconds from the call to the description applied
+    virtual void OnSetLocalDescription(int error, std::string errstr, long elapsed_us) {}
+
+    // This callback will be activated when IRtcCenter::SetRemoteDescription() completes,
+    //      the same as OnSetLocalDescription().
+    virtual void OnSetRemoteDescription(int error, std::string errstr, long elapsed_us) {}
 };
 
 #endif // OBJC
@@ -312,10 +452,14 @@ public:
     virtual void GetDevices(const device_kind_t kind, devices_t & devices) = 0;
 
     // To get local stream of audio & video, SUCCESS or fail indicated by IRtcSink::OnGetUserMedia()
+    //      It returns immediately and a/v devices are opened in background.
     // @param constraints: [in] media constrainsts(audio/video), refer to media_constraints_t
     // @return 0 if OK, else fail
     virtual long GetUserMedia(const media_constraints_t & constraints) = 0;
 
+    // To cancel the pending GetUserMedia, no IRtcSink::OnGetUserMedia() after it returns
+    virtual void CancelUserMedia() = 0;
+
     // To create peer conncetion, default with google stun server
     // @return 0 if OK, else fail
     virtual long CreatePeerConnection() = 0;
@@ -325,6 +469,19 @@ public:
     // @return 0 if OK, else fail
     virtual long CreatePeerConnection(const ice_servers_t & servers) = 0;
 
+    // To create peer conncetion with configuration
+    // @param servers: [in] stun/turn server list, refer to ice_servers_t
+    // @param config: [in] refer to rtc_config_t
+    // @return 0 if OK, else fail
+    virtual long CreatePeerConnection(const ice_servers_t & servers, const rtc_config_t & config) = 0;
+
+    // To keep peer connections created ahead in background, which CreatePeerConnection()
+    //      takes at once if created with the same servers and config, and the pool is refilled.
+    // @param size: [in] number of pooled peer connections, 0 to disable (default)
+    // @param servers: [in] stun/turn server list, or empty for the default of CreatePeerConnection()
+    // @param config: [in] refer to rtc_config_t, with which candidates are gathered in pool
+    virtual void SetPeerConnectionPool(int size, const ice_servers_t & servers, const rtc_config_t & config) = 0;
+
     // To add local stream into peer connection,
     //      which should be callbed after success of both GetUserMedia and CreatePeerConnection.
     // @return 0 if OK, else fail
@@ -350,6 +507,12 @@ public:
     // @return 0 if OK, else fail
     virtual long AnswerCall() = 0;
 
+    // To restart ice on current peer connection when its ice connection failed or disconnected,
+    //      media is kept alive. The offer is returned by IRtcSink::OnSessionDescription()
+    //      and negotiated as SetupCall().
+    // @return 0 if OK, else fail
+    virtual long RestartIce() = 0;
+
     // To close call
     virtual void Close() = 0;
 
@@ -364,9 +527,49 @@ public:
     virtual long SetRemoteDescription(const std::string &sdp) = 0;
 
     // To add remote ice candidate into current peer connection
-    // @param candidate: [in] ice candidate(json format)
+    // @param candidate: [in] ice candidate(json format), or a json array of candidates
     // @return 0 if OK, else fail
     virtual long AddIceCandidate(const std::string &candidate) = 0;
+
+    // To send local ice candidates in batch, the candidates gathered within window_ms
+    //      or up to max_count are sent by one IRtcSink::OnIceCandidate() in json array,
+    //      and the rest are flushed when gathering completes.
+    // @param window_ms: [in] coalescing window, e.g. 20ms, 0 to disable batching (default)
+    // @param max_count: [in] max candidates in one batch, 0 for no limit
+    virtual void SetCandidateBatching(int window_ms, int max_count) = 0;
+
+    // To select the format of sdp and candidates returned by IRtcSink, which
+    //      may hold '\0' in binary format. Both formats are accepted as input.
+    // @param format: [in] refer to signaling_format_t
+    virtual void SetSignalingFormat(int format) = 0;
+
+    // To set the policy of codecs and bandwidth, which is applied to the parsed
+    //      local sdp of SetupCall()/AnswerCall() before it is serialized.
+    // @param policy: [in] refer to sdp_policy_t
+    virtual void SetSdpPolicy(const sdp_policy_t &policy) = 0;
+
+    // To configure the adaptation of local video when cpu is overused,
+    //      resolution and then frame rate are stepped down along the ladder.
+    // @param config: [in] refer to adaptation_config_t
+    // @return 0 if OK, else fail
+    virtual long SetAdaptation(const adaptation_config_t &config) = 0;
+
+    // To get the current state of cpu overuse adaptation
+    // @param state: [out] refer to adaptation_state_t
+    virtual void GetAdaptation(adaptation_state_t &state) = 0;
+
+    // To cap the threads of each h264 encoder created afterwards, which otherwise
+    //      encodes by slices in up to the number of cores (limited by resolution).
+    // @param max_threads: [in] threads per encoder, 0 for no cap (default)
+    // @return 0 if OK, else fail (e.g. without h264)
+    virtual long SetEncoderThreads(int max_threads) = 0;
+
+    // To set the temporal layers of each h264 encoder created afterwards, so that the
+    //      enhancement layers could be dropped under congestion without a key frame.
+    //      (video_constraints_t::temporalLayeredScreencast is for vp8 screencast)
+    // @param layers: [in] 1 (default) to 3
+    // @return 0 if OK, else fail (e.g. without h264)
+    virtual long SetTemporalLayers(int layers) = 0;
 };
 
 
@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <new>
 
 #include "xrtc_api.h"
 
@@ -65,83 +66,119 @@ enum media_t {
 //
 // For capability and constraint
 
+// The audio or video constraints are held inline as a tagged union, so that
+// no heap is used.
 typedef struct constraints_t {
     media_t mtype;
-    void *ptr;
     
-    constraints_t() : mtype(XRTC_UNKNOWN), ptr(NULL) {}
-    constraints_t(constraints_t &other) : mtype(XRTC_UNKNOWN), ptr(NULL) {
+    constraints_t() : mtype(XRTC_UNKNOWN) {}
+    constraints_t(const constraints_t &other) : mtype(XRTC_UNKNOWN) {
         *this = other;
     }
-    constraints_t(const constraints_t &other) : mtype(XRTC_UNKNOWN), ptr(NULL) {
+    constraints_t(const audio_constraints_t &other) : mtype(XRTC_UNKNOWN) {
         *this = other;
     }
-    constraints_t(const audio_constraints_t &other) : mtype(XRTC_AUDIO), ptr(NULL) {
+    constraints_t(const video_constraints_t &other) : mtype(XRTC_UNKNOWN) {
         *this = other;
     }
-    constraints_t(const video_constraints_t &other) : mtype(XRTC_VIDEO), ptr(NULL) {
-         *this = other;
+#if __cplusplus >= 201103L
+    constraints_t(constraints_t &&other) : mtype(XRTC_UNKNOWN) {
+        swap(other);
     }
+    constraints_t & operator = (constraints_t &&other) {
+        if (this != &other) {
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+#endif
     virtual ~constraints_t() { release(); }
     
     constraints_t & operator = (const constraints_t &other) {
-        if (other.ptr) {
-            switch(other.mtype) {
-                case XRTC_UNKNOWN: break;
-                case XRTC_AUDIO: copyaudio(*(audio_constraints_t *)other.ptr); break;
-                case XRTC_VIDEO: copyvideo(*(video_constraints_t *)other.ptr); break;
-            }
+        if (this == &other) return *this;
+        switch(other.mtype) {
+            case XRTC_UNKNOWN: release(); break;
+            case XRTC_AUDIO: *this = *other.audio(); break;
+            case XRTC_VIDEO: *this = *other.video(); break;
         }
         return *this;
     }
     constraints_t & operator = (const audio_constraints_t &other) {
-        copyaudio(other);
+        if (mtype == XRTC_AUDIO) {
+            *audio() = other;
+        }else {
+            release();
+            new (m_storage.audio) audio_constraints_t(other);
+            mtype = XRTC_AUDIO;
+        }
         return *this;
     }
     constraints_t & operator = (const video_constraints_t &other) {
-        copyvideo(other);
+        if (mtype == XRTC_VIDEO) {
+            *video() = other;
+        }else {
+            release();
+            new (m_storage.video) video_constraints_t(other);
+            mtype = XRTC_VIDEO;
+        }
         return *this;
     }
     
-private:
-    void copyaudio(const audio_constraints_t &other) {
-        audio_constraints_t *audio = new audio_constraints_t;
-        audio->aec = other.aec;
-        audio->aec2 = other.aec2;
-        audio->agc = other.agc;
-        audio->agc2 = other.agc2;
-        audio->ns = other.ns;
-        audio->ns2 = other.ns2;
-        audio->highPassFilter = other.highPassFilter;
-        audio->typingNosieDetection = other.typingNosieDetection;
-        release();
-        ptr = audio;
-        mtype = XRTC_AUDIO;
+    // NULL if not the type
+    audio_constraints_t *audio() {
+        return (mtype == XRTC_AUDIO) ? (audio_constraints_t *)m_storage.audio : NULL;
+    }
+    const audio_constraints_t *audio() const {
+        return (mtype == XRTC_AUDIO) ? (const audio_constraints_t *)m_storage.audio : NULL;
+    }
+    video_constraints_t *video() {
+        return (mtype == XRTC_VIDEO) ? (video_constraints_t *)m_storage.video : NULL;
     }
-    void copyvideo(const video_constraints_t &other) {
-        video_constraints_t *video = new video_constraints_t;
-        video->device = other.device;
-        video->aspectRatio = other.aspectRatio;
-        video->width = other.width;
-        video->height = other.height;
-        video->frameRate = other.frameRate;
-        video->noiseReduction = other.noiseReduction;
-        video->leakyBucket = other.leakyBucket;
-        video->temporalLayeredScreencast = other.temporalLayeredScreencast;
-        release();
-        ptr = video;
-        mtype = XRTC_VIDEO;
+    const video_constraints_t *video() const {
+        return (mtype == XRTC_VIDEO) ? (const video_constraints_t *)m_storage.video : NULL;
+    }
+    
+    void swap(constraints_t &other) {
+        if (this == &other) return;
+        constraints_t tmp;
+        tmp.take(*this);
+        take(other);
+        other.take(tmp);
+    }
+    
+private:
+    // move other's content into this (which must be empty), and leave other empty
+    void take(constraints_t &other) {
+        switch(other.mtype) {
+            case XRTC_UNKNOWN: 
+                break;
+            case XRTC_AUDIO: 
+                new (m_storage.audio) audio_constraints_t(*other.audio());
+                break;
+            case XRTC_VIDEO: 
+                new (m_storage.video) video_constraints_t(*other.video());
+                break;
+        }
+        mtype = other.mtype;
+        other.release();
     }
     void release() {
-        if (ptr) {
-            switch(mtype) {
-                case XRTC_UNKNOWN: break;
-                case XRTC_AUDIO: delete ((audio_constraints_t *)ptr);; break;
-                case XRTC_VIDEO: delete ((video_constraints_t *)ptr); break;
-            }
-            ptr = NULL;
+        switch(mtype) {
+            case XRTC_UNKNOWN: break;
+            case XRTC_AUDIO: ((audio_constraints_t *)m_storage.audio)->~audio_constraints_t(); break;
+            case XRTC_VIDEO: ((video_constraints_t *)m_storage.video)->~video_constraints_t(); break;
         }
+        mtype = XRTC_UNKNOWN;
     }
+    
+    union {
+        char audio[sizeof(audio_constraints_t)];
+        char video[sizeof(video_constraints_t)];
+        void *align_ptr;
+        double align_double;
+        long long align_ll;
+    } m_storage;
 }constraints_t;
     
 typedef constraints_t MediaTrackConstraints;
@@ -190,6 +227,15 @@ struct RTCIceServer {
 
 struct RTCConfiguration {
     sequence<RTCIceServer> iceServers;
+    int bundlePolicy;           // refer to bundle_policy_t
+    int rtcpMuxPolicy;          // refer to rtcp_mux_policy_t
+    int iceTransportPolicy;     // refer to ice_transport_policy_t
+    int networkIgnore;          // refer to network_filter_t
+    sequence<DOMString> networkAllowlist;
+    int ipPolicy;               // refer to ip_policy_t
+
+    RTCConfiguration() : bundlePolicy(kBundlePolicyBalanced), rtcpMuxPolicy(kRtcpMuxPolicyNegotiate),
+        iceTransportPolicy(kIceTransportAll), networkIgnore(0), ipPolicy(kIpPolicyDefault) {}
 };
 
 
@@ -131,7 +131,9 @@ public:
 
 class NavigatorUserMedia {
 public:
+    // The callback is invoked from a background thread once the tracks are opened.
     static void getUserMedia (const MediaStreamConstraints & constraints, NavigatorUserMediaCallback *callback);
+    static void cancelUserMedia (NavigatorUserMediaCallback *callback);
 };
 
 
@@ -148,6 +150,9 @@ public:
 
     virtual void onsuccess(const DOMString &sdp)        {}
     virtual void onfailure(const DOMString &error)      {}
+    // not in w3c: completion of set{Local,Remote}Description, error is empty if OK
+    virtual void onsetlocaldescription(const DOMString &error, long elapsed_us)     {}
+    virtual void onsetremotedescription(const DOMString &error, long elapsed_us)    {}
     virtual void onerror()                              {}
 };
 
@@ -172,6 +177,11 @@ public:
 
     virtual void updateIce (const RTCConfiguration & configuration, const MediaConstraints & constraints) {}
     virtual void addIceCandidate (const DOMString & candidate) = 0;
+    // not in w3c: candidates are sent in one json array within window_ms or up to max_count
+    virtual void setCandidateBatching (int window_ms, int max_count) {}
+    // not in w3c: sdp and candidates are sent in json or binary, refer to signaling_format_t
+    virtual void setSignalingFormat (int format) {}
+    virtual void setSdpPolicy (const sdp_policy_t & policy) {}
 
     virtual sequence<MediaStreamPtr> getLocalStreams ()         = 0;
     virtual sequence<MediaStreamPtr> getRemoteStreams ()        = 0;
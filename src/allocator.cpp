@@ -0,0 +1,567 @@
+#include <string.h>
+#include <algorithm>
+
+#include "allocator.h"
+#include "ubase/error.h"
+
+#include "talk/base/helpers.h"
+#include "talk/p2p/base/constants.h"
+#include "talk/app/webrtc/jsepicecandidate.h"
+
+namespace xrtc {
+
+//
+// The session gathers in the pool before being taken by a channel, and then
+//  replays the ports and candidates which the channel has missed, except the
+//  candidates already attached to the local description.
+class CPooledSession : public cricket::PortAllocatorSession {
+public:
+    CPooledSession(CPortAllocator *owner, size_t index, cricket::PortAllocatorSession *session,
+            const std::string &ice_ufrag, const std::string &ice_pwd)
+        : cricket::PortAllocatorSession(session->content_name(), session->component(), ice_ufrag, ice_pwd, session->flags()),
+        m_owner(owner), m_index(index), m_session(session), m_taken(false), m_done(false)
+    {
+        m_session->SignalPortReady.connect(this, &CPooledSession::OnPortReady);
+        m_session->SignalCandidatesReady.connect(this, &CPooledSession::OnCandidatesReady);
+        m_session->SignalCandidatesAllocationDone.connect(this, &CPooledSession::OnCandidatesAllocationDone);
+    }
+    virtual ~CPooledSession() {}
+
+    // on the worker thread
+    void Prestart() {
+        m_session->StartGettingPorts();
+    }
+    void Take(const std::vector<std::string> &attached) {
+        m_owner = NULL;
+        m_attached = attached;
+    }
+
+    virtual void StartGettingPorts() {
+        if (m_taken) {
+            m_session->StartGettingPorts();
+            return;
+        }
+
+        m_taken = true;
+        for (size_t k=0; k < m_ports.size(); k++) {
+            SignalPortReady(this, m_ports[k]);
+        }
+        std::vector<cricket::Candidate> missed;
+        for (size_t k=0; k < m_candidates.size(); k++) {
+            if (std::find(m_attached.begin(), m_attached.end(), m_candidates[k].id()) == m_attached.end())
+                missed.push_back(m_candidates[k]);
+        }
+        if (!missed.empty()) {
+            SignalCandidatesReady(this, missed);
+        }
+        if (m_done) {
+            SignalCandidatesAllocationDone(this);
+        }
+        m_ports.clear();
+        m_candidates.clear();
+        m_attached.clear();
+    }
+    virtual void StopGettingPorts() {
+        m_session->StopGettingPorts();
+    }
+    virtual bool IsGettingPorts() {
+        return m_session->IsGettingPorts();
+    }
+    virtual void set_generation(uint32 generation) {
+        cricket::PortAllocatorSession::set_generation(generation);
+        m_session->set_generation(generation);
+    }
+
+private:
+    void OnPortReady(cricket::PortAllocatorSession *session, cricket::PortInterface *port) {
+        if (m_taken) {
+            SignalPortReady(this, port);
+            return;
+        }
+        port->SignalDestroyed.connect(this, &CPooledSession::OnPortDestroyed);
+        m_ports.push_back(port);
+    }
+    void OnPortDestroyed(cricket::PortInterface *port) {
+        std::vector<cricket::PortInterface *>::iterator iter = std::find(m_ports.begin(), m_ports.end(), port);
+        if (iter != m_ports.end()) {
+            m_ports.erase(iter);
+        }
+    }
+    void OnCandidatesReady(cricket::PortAllocatorSession *session, const std::vector<cricket::Candidate> &candidates) {
+        if (m_taken) {
+            SignalCandidatesReady(this, candidates);
+            return;
+        }
+        m_candidates.insert(m_candidates.end(), candidates.begin(), candidates.end());
+        if (m_owner) {
+            m_owner->OnPooledCandidates(m_index, candidates);
+        }
+    }
+    void OnCandidatesAllocationDone(cricket::PortAllocatorSession *session) {
+        if (m_taken) {
+            SignalCandidatesAllocationDone(this);
+            return;
+        }
+        m_done = true;
+    }
+
+    CPortAllocator *m_owner;
+    size_t m_index;
+    talk_base::scoped_ptr<cricket::PortAllocatorSession> m_session;
+    bool m_taken;       // started by the channel
+    bool m_done;
+    std::vector<cricket::PortInterface *> m_ports;
+    std::vector<cricket::Candidate> m_candidates;
+    std::vector<std::string> m_attached;
+};
+
+
+//
+//> for CFilteredNetworkManager
+static const char * const kVpnPrefixes[] = {"tun", "tap", "ppp", "utun", "ipsec", NULL};
+static const char * const kVirtualPrefixes[] = {"vmnet", "vboxnet", "docker", "veth", "virbr", NULL};
+
+static bool HasPrefix(const std::string &name, const char * const prefixes[])
+{
+    for (int k=0; prefixes[k]; k++) {
+        if (name.compare(0, strlen(prefixes[k]), prefixes[k]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool IsLinkLocal(const talk_base::IPAddress &ip)
+{
+    if (ip.family() == AF_INET) {
+        return (ip.v4AddressAsHostOrderInteger() >> 16) == 0xA9FE;   // 169.254.0.0/16
+    }else if (ip.family() == AF_INET6) {
+        const uint8 *bytes = ip.ipv6_address().s6_addr;
+        return bytes[0] == 0xFE && (bytes[1] & 0xC0) == 0x80;       // fe80::/10
+    }
+    return false;
+}
+
+CFilteredNetworkManager::CFilteredNetworkManager()
+{
+    m_network_ignore = 0;
+    m_ip_policy = kIpPolicyDefault;
+    m_network_manager.SignalNetworksChanged.connect(this, &CFilteredNetworkManager::OnNetworksChanged);
+    m_network_manager.SignalError.connect(this, &CFilteredNetworkManager::OnError);
+}
+
+CFilteredNetworkManager::~CFilteredNetworkManager()
+{
+}
+
+void CFilteredNetworkManager::SetConfig(const rtc_config_t &config)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_network_ignore = config.network_ignore;
+    m_network_allowlist = config.network_allowlist;
+    m_ip_policy = config.ip_policy;
+}
+
+void CFilteredNetworkManager::StartUpdating()
+{
+    m_network_manager.StartUpdating();
+}
+
+void CFilteredNetworkManager::StopUpdating()
+{
+    m_network_manager.StopUpdating();
+}
+
+void CFilteredNetworkManager::GetNetworks(NetworkList* networks) const
+{
+    return_assert(networks);
+
+    NetworkList all;
+    m_network_manager.GetNetworks(&all);
+    networks->clear();
+    for (size_t k=0; k < all.size(); k++) {
+        if (!IsIgnored(all[k])) {
+            networks->push_back(all[k]);
+        }
+    }
+}
+
+bool CFilteredNetworkManager::IsIgnored(const talk_base::Network *network) const
+{
+    ubase::ScopedLock lock(m_mutex);
+    if (!m_network_allowlist.empty() &&
+        std::find(m_network_allowlist.begin(), m_network_allowlist.end(), network->name()) == m_network_allowlist.end())
+        return true;
+    if (m_ip_policy == kIpPolicyV4Only && network->ip().family() != AF_INET)
+        return true;
+    if (m_ip_policy == kIpPolicyV6Only && network->ip().family() != AF_INET6)
+        return true;
+    if ((m_network_ignore & kNetworkIgnoreLoopback) && talk_base::IPIsLoopback(network->ip()))
+        return true;
+    if ((m_network_ignore & kNetworkIgnoreLinkLocal) && IsLinkLocal(network->ip()))
+        return true;
+    if ((m_network_ignore & kNetworkIgnoreVpn) && HasPrefix(network->name(), kVpnPrefixes))
+        return true;
+    if ((m_network_ignore & kNetworkIgnoreVirtual) && HasPrefix(network->name(), kVirtualPrefixes))
+        return true;
+    return false;
+}
+
+void CFilteredNetworkManager::OnNetworksChanged()
+{
+    SignalNetworksChanged();
+}
+
+void CFilteredNetworkManager::OnError()
+{
+    SignalError();
+}
+
+
+//
+//> for CPortAllocatorFactory
+talk_base::scoped_refptr<CPortAllocatorFactory> CPortAllocatorFactory::Create(
+        talk_base::Thread *worker_thread,
+        const rtc_config_t &config)
+{
+    // Ports must live on the worker thread of the factory, as webrtc::PortAllocatorFactory.
+    returnv_assert(worker_thread, NULL);
+    return new talk_base::RefCountedObject<CPortAllocatorFactory>(worker_thread, config);
+}
+
+CPortAllocatorFactory::CPortAllocatorFactory(talk_base::Thread *worker_thread, const rtc_config_t &config)
+    : m_worker_thread(worker_thread), m_config(config), m_allocator(NULL)
+{
+    m_network_manager.reset(new CFilteredNetworkManager());
+    m_network_manager->SetConfig(config);
+    m_socket_factory.reset(new talk_base::BasicPacketSocketFactory(worker_thread));
+}
+
+CPortAllocatorFactory::~CPortAllocatorFactory()
+{
+}
+
+cricket::PortAllocator* CPortAllocatorFactory::CreatePortAllocator(
+        const std::vector<StunConfiguration>& stun_servers,
+        const std::vector<TurnConfiguration>& turn_configurations)
+{
+    talk_base::SocketAddress stun_server;
+    if (!stun_servers.empty()) {
+        stun_server = stun_servers[0].server;
+    }
+
+    CPortAllocator *allocator = new CPortAllocator(this, m_worker_thread,
+            m_network_manager.get(), m_socket_factory.get(), stun_server, m_config);
+    for (size_t k=0; k < turn_configurations.size(); k++) {
+        const TurnConfiguration &turn = turn_configurations[k];
+        cricket::ProtocolType protocol;
+        if (!cricket::StringToProto(turn.transport_type.c_str(), &protocol)) {
+            LOGW("invalid transport of turn server: "<<turn.transport_type);
+            continue;
+        }
+        cricket::RelayServerConfig relay_server(cricket::RELAY_TURN);
+        relay_server.ports.push_back(cricket::ProtocolAddress(turn.server, protocol, turn.secure));
+        relay_server.credentials = cricket::RelayCredentials(turn.username, turn.password);
+        allocator->AddRelay(relay_server);
+    }
+
+    {
+        ubase::ScopedLock lock(m_mutex);
+        m_allocator = allocator;
+    }
+    allocator->StartPool();
+    return allocator;
+}
+
+void CPortAllocatorFactory::OnLocalDescription(webrtc::SessionDescriptionInterface *description, bool first)
+{
+    return_assert(description);
+
+    ubase::ScopedLock lock(m_mutex);
+    if (m_allocator) {
+        m_allocator->SetBundleContent(description->description());
+        if (first) {
+            m_allocator->AttachCandidatePool(description);
+        }
+    }
+}
+
+void CPortAllocatorFactory::SetConfig(const rtc_config_t &config)
+{
+    ubase::ScopedLock lock(m_mutex);
+    int pool_size = m_config.ice_candidate_pool_size;
+    m_config = config;
+    m_config.ice_candidate_pool_size = pool_size;     // only at creation
+    m_network_manager->SetConfig(m_config);
+    if (m_allocator) {
+        m_allocator->SetConfig(m_config);
+    }
+}
+
+bool CPortAllocatorFactory::IsNeeded(const rtc_config_t &config)
+{
+    return (config.ice_candidate_pool_size > 0 ||
+            config.bundle_policy == kBundlePolicyMaxBundle ||
+            config.rtcp_mux_policy == kRtcpMuxPolicyRequire ||
+            config.ice_transport_policy != kIceTransportAll ||
+            config.network_ignore != 0 ||
+            !config.network_allowlist.empty() ||
+            config.ip_policy != kIpPolicyDefault);
+}
+
+void CPortAllocatorFactory::GetPoolStats(size_t &candidates, size_t &taken)
+{
+    ubase::ScopedLock lock(m_mutex);
+    candidates = taken = 0;
+    if (m_allocator) {
+        m_allocator->GetPoolStats(candidates, taken);
+    }
+}
+
+void CPortAllocatorFactory::OnAllocatorDestroyed(CPortAllocator *allocator)
+{
+    ubase::ScopedLock lock(m_mutex);
+    if (m_allocator == allocator) {
+        m_allocator = NULL;
+    }
+}
+
+
+//
+//> for CPortAllocator
+CPortAllocator::CPortAllocator(talk_base::scoped_refptr<CPortAllocatorFactory> factory,
+        talk_base::Thread *worker_thread,
+        talk_base::NetworkManager *network_manager,
+        talk_base::PacketSocketFactory *socket_factory,
+        const talk_base::SocketAddress &stun_server,
+        const rtc_config_t &config)
+    : cricket::BasicPortAllocator(network_manager, socket_factory, stun_server),
+    m_factory(factory), m_worker_thread(worker_thread), m_config(config), m_taken(0)
+{
+    // The credentials are known at once for the local description,
+    //  while the sessions are created on the worker thread.
+    for (int k=0; k < config.ice_candidate_pool_size; k++) {
+        pooled_transport_t transport;
+        transport.ufrag = talk_base::CreateRandomString(cricket::ICE_UFRAG_LENGTH);
+        transport.pwd = talk_base::CreateRandomString(cricket::ICE_PWD_LENGTH);
+        for (int c=0; c < kPooledComponents; c++) {
+            transport.sessions[c] = NULL;
+        }
+        m_pool.push_back(transport);
+    }
+}
+
+CPortAllocator::~CPortAllocator()
+{
+    m_factory->OnAllocatorDestroyed(this);
+    if (!m_pool.empty()) {
+        m_worker_thread->Clear(this);
+        m_worker_thread->Send(this, MSG_STOP_POOL);
+    }
+}
+
+void CPortAllocator::SetConfig(const rtc_config_t &config)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_config = config;
+}
+
+void CPortAllocator::StartPool()
+{
+    if (!m_pool.empty()) {
+        m_worker_thread->Post(this, MSG_START_POOL);
+    }
+}
+
+void CPortAllocator::AttachCandidatePool(webrtc::SessionDescriptionInterface *description)
+{
+    return_assert(description);
+    cricket::SessionDescription *sdesc = const_cast<cricket::SessionDescription *>(description->description());
+    return_assert(sdesc);
+
+    // The bundled contents share the transport of the first one in group.
+    const cricket::ContentGroup *group = sdesc->GetGroupByName(cricket::GROUP_TYPE_BUNDLE);
+    const std::string *bundle_first = group ? group->FirstContentName() : NULL;
+
+    ubase::ScopedLock lock(m_mutex);
+    const cricket::ContentInfos &contents = sdesc->contents();
+    for (size_t k=0; k < contents.size(); k++) {
+        const cricket::ContentInfo &content = contents[k];
+        cricket::TransportInfo *tinfo = sdesc->GetTransportInfoByName(content.name);
+        if (content.rejected || !tinfo)
+            continue;
+        if (m_config.bundle_policy == kBundlePolicyMaxBundle && content.name != m_bundle_content)
+            continue;
+        if (bundle_first && content.name != *bundle_first && group->HasContentName(content.name))
+            continue;
+
+        // the same transport for the content when created again
+        pooled_transport_t *transport = NULL;
+        for (size_t i=0; i < m_pool.size() && !transport; i++) {
+            if (m_pool[i].content_name == content.name)
+                transport = &m_pool[i];
+        }
+        for (size_t i=0; i < m_pool.size() && !transport; i++) {
+            if (m_pool[i].content_name.empty()) {
+                transport = &m_pool[i];
+                transport->content_name = content.name;
+            }
+        }
+        if (!transport)
+            break;
+
+        tinfo->description.ice_ufrag = transport->ufrag;
+        tinfo->description.ice_pwd = transport->pwd;
+        for (size_t i=0; i < transport->candidates.size(); i++) {
+            webrtc::JsepIceCandidate candidate(content.name, (int)k, transport->candidates[i]);
+            if (description->AddCandidate(&candidate))
+                transport->attached.push_back(transport->candidates[i].id());
+        }
+        LOGD("pooled transport for "<<content.name<<", candidates="<<transport->candidates.size());
+    }
+
+    const cricket::TransportInfo *first = bundle_first ? sdesc->GetTransportInfoByName(*bundle_first) : NULL;
+    if (!first)
+        return;
+    for (size_t k=0; k < contents.size(); k++) {
+        cricket::TransportInfo *tinfo = sdesc->GetTransportInfoByName(contents[k].name);
+        if (tinfo && tinfo != first && group->HasContentName(contents[k].name)) {
+            tinfo->description.ice_ufrag = first->description.ice_ufrag;
+            tinfo->description.ice_pwd = first->description.ice_pwd;
+        }
+    }
+}
+
+void CPortAllocator::SetBundleContent(const cricket::SessionDescription *sdesc)
+{
+    return_assert(sdesc);
+
+    ubase::ScopedLock lock(m_mutex);
+    const cricket::ContentGroup *group = sdesc->GetGroupByName(cricket::GROUP_TYPE_BUNDLE);
+    if (group && group->FirstContentName()) {
+        m_bundle_content = *group->FirstContentName();
+        return;
+    }
+
+    const cricket::ContentInfos &contents = sdesc->contents();
+    for (size_t k=0; k < contents.size(); k++) {
+        if (!contents[k].rejected) {
+            m_bundle_content = contents[k].name;
+            break;
+        }
+    }
+}
+
+void CPortAllocator::GetPoolStats(size_t &candidates, size_t &taken)
+{
+    ubase::ScopedLock lock(m_mutex);
+    candidates = 0;
+    for (size_t k=0; k < m_pool.size(); k++) {
+        candidates += m_pool[k].candidates.size();
+    }
+    taken = m_taken;
+}
+
+// The flags disabling gathering for the session of content and component
+uint32 CPortAllocator::GetPolicyFlags(const std::string &content_name, int component)
+{
+    const uint32 kDisableAll = cricket::PORTALLOCATOR_DISABLE_UDP | cricket::PORTALLOCATOR_DISABLE_STUN |
+        cricket::PORTALLOCATOR_DISABLE_RELAY | cricket::PORTALLOCATOR_DISABLE_TCP;
+
+    ubase::ScopedLock lock(m_mutex);
+    uint32 flags = 0;
+    if (m_config.ip_policy == kIpPolicyV6Only || m_config.ip_policy == kIpPolicyBoth)
+        flags |= cricket::PORTALLOCATOR_ENABLE_IPV6;
+
+    if (m_config.ice_transport_policy == kIceTransportNone)
+        return kDisableAll;
+    if (m_config.rtcp_mux_policy == kRtcpMuxPolicyRequire && component == cricket::ICE_CANDIDATE_COMPONENT_RTCP)
+        return kDisableAll;
+    if (m_config.bundle_policy == kBundlePolicyMaxBundle && !content_name.empty() &&
+        !m_bundle_content.empty() && content_name != m_bundle_content)
+        return kDisableAll;
+    if (m_config.ice_transport_policy == kIceTransportRelay)
+        flags |= cricket::PORTALLOCATOR_DISABLE_UDP | cricket::PORTALLOCATOR_DISABLE_STUN | cricket::PORTALLOCATOR_DISABLE_TCP;
+    else if (m_config.ice_transport_policy == kIceTransportHost)
+        flags |= cricket::PORTALLOCATOR_DISABLE_STUN | cricket::PORTALLOCATOR_DISABLE_RELAY;
+    return flags;
+}
+
+void CPortAllocator::OnPooledCandidates(size_t index, const std::vector<cricket::Candidate> &candidates)
+{
+    ubase::ScopedLock lock(m_mutex);
+    if (index < m_pool.size()) {
+        std::vector<cricket::Candidate> &pooled = m_pool[index].candidates;
+        pooled.insert(pooled.end(), candidates.begin(), candidates.end());
+    }
+}
+
+cricket::PortAllocatorSession* CPortAllocator::CreateSessionInternal(
+        const std::string& content_name,
+        int component,
+        const std::string& ice_ufrag,
+        const std::string& ice_pwd)
+{
+    if (component >= 1 && component <= kPooledComponents) {
+        ubase::ScopedLock lock(m_mutex);
+        for (size_t k=0; k < m_pool.size(); k++) {
+            pooled_transport_t &transport = m_pool[k];
+            CPooledSession *session = transport.sessions[component-1];
+            if (session && transport.ufrag == ice_ufrag && transport.pwd == ice_pwd) {
+                LOGD("take pooled session, content="<<content_name<<", component="<<component);
+                transport.sessions[component-1] = NULL;
+                session->Take(transport.attached);
+                m_taken++;
+                return session;
+            }
+        }
+    }
+
+    cricket::PortAllocatorSession *session = cricket::BasicPortAllocator::CreateSessionInternal(
+            content_name, component, ice_ufrag, ice_pwd);
+    if (session) {
+        session->set_flags(session->flags() | GetPolicyFlags(content_name, component));
+    }
+    return session;
+}
+
+void CPortAllocator::OnMessage(talk_base::Message *msg)
+{
+    ubase::ScopedLock lock(m_mutex);
+    switch(msg->message_id) {
+    case MSG_START_POOL:
+        for (size_t k=0; k < m_pool.size(); k++) {
+            pooled_transport_t &transport = m_pool[k];
+            for (int c=0; c < kPooledComponents; c++) {
+                // no pooled rtcp session when rtcp-mux is required
+                uint32 policy_flags = GetPolicyFlags("", c+1);
+                if (c > 0 && m_config.rtcp_mux_policy == kRtcpMuxPolicyRequire)
+                    continue;
+
+                cricket::PortAllocatorSession *session = cricket::BasicPortAllocator::CreateSessionInternal(
+                        "", c+1, transport.ufrag, transport.pwd);
+                if (!session)
+                    continue;
+
+                // Ports must take the session's credentials which are in the sdp,
+                //  as webrtc session sets for its own sessions.
+                session->set_flags(session->flags() | policy_flags |
+                        cricket::PORTALLOCATOR_ENABLE_SHARED_UFRAG |
+                        cricket::PORTALLOCATOR_ENABLE_SHARED_SOCKET);
+                CPooledSession *pooled = new CPooledSession(this, k, session, transport.ufrag, transport.pwd);
+                transport.sessions[c] = pooled;
+                pooled->Prestart();
+            }
+        }
+        break;
+    case MSG_STOP_POOL:
+        for (size_t k=0; k < m_pool.size(); k++) {
+            for (int c=0; c < kPooledComponents; c++) {
+                delete m_pool[k].sessions[c];
+                m_pool[k].sessions[c] = NULL;
+            }
+        }
+        break;
+    }
+}
+
+} // namespace xrtc
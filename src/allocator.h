@@ -0,0 +1,153 @@
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include "webrtc.h"
+#include "ubase/mutex.h"
+
+#include "talk/base/network.h"
+#include "talk/p2p/base/basicpacketsocketfactory.h"
+#include "talk/p2p/client/basicportallocator.h"
+
+namespace xrtc {
+
+class CPortAllocator;
+class CPooledSession;
+
+//
+//> for CFilteredNetworkManager
+// The networks of BasicNetworkManager in the allowlist and ip family, without the ignored
+// types, refer to rtc_config_t.
+class CFilteredNetworkManager : public talk_base::NetworkManager, public sigslot::has_slots<> {
+public:
+    explicit CFilteredNetworkManager();
+    virtual ~CFilteredNetworkManager();
+
+    void SetConfig(const rtc_config_t &config);
+
+    virtual void StartUpdating();
+    virtual void StopUpdating();
+    virtual void GetNetworks(NetworkList* networks) const;
+
+private:
+    bool IsIgnored(const talk_base::Network *network) const;
+    void OnNetworksChanged();
+    void OnError();
+
+    talk_base::BasicNetworkManager m_network_manager;
+    int m_network_ignore;
+    std::vector<std::string> m_network_allowlist;
+    int m_ip_policy;
+    mutable ubase::Mutex m_mutex;
+};
+
+//
+//> for CPortAllocatorFactory
+// Creates the port allocator of one peer connection with the options of rtc_config_t.
+class CPortAllocatorFactory : public webrtc::PortAllocatorFactoryInterface {
+public:
+    // @param worker_thread: the worker thread of the factory creating the peer connection
+    static talk_base::scoped_refptr<CPortAllocatorFactory> Create(
+            talk_base::Thread *worker_thread,
+            const rtc_config_t &config);
+
+    virtual cricket::PortAllocator* CreatePortAllocator(
+            const std::vector<StunConfiguration>& stun_servers,
+            const std::vector<TurnConfiguration>& turn_configurations);
+
+    // For the created offer/answer. Before the first local description is set, its ice
+    //  credentials are replaced by the pooled ones, and the candidates gathered so far are attached.
+    void OnLocalDescription(webrtc::SessionDescriptionInterface *description, bool first);
+
+    // The policies of candidates apply to gathering afterwards.
+    void SetConfig(const rtc_config_t &config);
+
+    // If the default allocator of factory is not enough for the config
+    static bool IsNeeded(const rtc_config_t &config);
+
+    // The candidates gathered in the pool, and the pooled sessions taken by channels.
+    void GetPoolStats(size_t &candidates, size_t &taken);
+
+protected:
+    friend class CPortAllocator;
+
+    CPortAllocatorFactory(talk_base::Thread *worker_thread, const rtc_config_t &config);
+    virtual ~CPortAllocatorFactory();
+
+    void OnAllocatorDestroyed(CPortAllocator *allocator);
+
+private:
+    talk_base::Thread *m_worker_thread;
+    rtc_config_t m_config;
+    talk_base::scoped_ptr<CFilteredNetworkManager> m_network_manager;
+    talk_base::scoped_ptr<talk_base::BasicPacketSocketFactory> m_socket_factory;
+    CPortAllocator *m_allocator;    // owned by the peer connection
+    ubase::Mutex m_mutex;
+};
+
+//
+//> for CPortAllocator
+// BasicPortAllocator with a pool of allocator sessions, which gather candidates
+// with pre-generated ice credentials before the first local description. Each
+// pooled transport holds the sessions of rtp and rtcp component, and is taken
+// by the channel whose local credentials match. The policies of rtc_config_t
+// disable gathering of each session by its content and component.
+class CPortAllocator : public cricket::BasicPortAllocator, public talk_base::MessageHandler {
+public:
+    CPortAllocator(talk_base::scoped_refptr<CPortAllocatorFactory> factory,
+            talk_base::Thread *worker_thread,
+            talk_base::NetworkManager *network_manager,
+            talk_base::PacketSocketFactory *socket_factory,
+            const talk_base::SocketAddress &stun_server,
+            const rtc_config_t &config);
+    virtual ~CPortAllocator();
+
+    void SetConfig(const rtc_config_t &config);
+    void StartPool();
+    void AttachCandidatePool(webrtc::SessionDescriptionInterface *description);
+    void SetBundleContent(const cricket::SessionDescription *sdesc);
+    void GetPoolStats(size_t &candidates, size_t &taken);
+
+    // called by pooled sessions on the worker thread
+    void OnPooledCandidates(size_t index, const std::vector<cricket::Candidate> &candidates);
+
+    virtual cricket::PortAllocatorSession* CreateSessionInternal(
+            const std::string& content_name,
+            int component,
+            const std::string& ice_ufrag,
+            const std::string& ice_pwd);
+
+    // for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    enum {
+        MSG_START_POOL,
+        MSG_STOP_POOL,
+    };
+    enum {
+        kPooledComponents = 2,      // rtp and rtcp
+    };
+
+    uint32 GetPolicyFlags(const std::string &content_name, int component);
+
+    typedef struct _pooled_transport {
+        std::string ufrag;
+        std::string pwd;
+        std::string content_name;   // the content assigned to, empty if free
+        std::vector<cricket::Candidate> candidates;
+        std::vector<std::string> attached;  // ids of the candidates in the local description
+        CPooledSession *sessions[kPooledComponents];    // NULL when taken
+    }pooled_transport_t;
+
+    talk_base::scoped_refptr<CPortAllocatorFactory> m_factory;
+    talk_base::Thread *m_worker_thread;
+    rtc_config_t m_config;
+    std::string m_bundle_content;       // the only content gathering for max-bundle
+    std::vector<pooled_transport_t> m_pool;
+    size_t m_taken;
+    ubase::Mutex m_mutex;
+};
+
+} // namespace xrtc
+
+#endif // _ALLOCATOR_H_
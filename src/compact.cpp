@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "compact.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+static const unsigned char kCompactMagic = 0xB5;
+static const unsigned char kCompactVersion = 1;
+
+enum {
+    kDescriptionMessage = 1,
+    kCandidateMessage = 2,
+    kCandidatesMessage = 3,
+};
+
+static const unsigned char kLiteralToken = 0xFF;
+static const unsigned char kPrefixToken = 0x80;
+
+// Whole sdp lines, token is the index.
+static const char * const kSdpLines[] = {
+    "v=0",
+    "s=-",
+    "t=0 0",
+    "c=IN IP4 0.0.0.0",
+    "a=rtcp:1 IN IP4 0.0.0.0",
+    "a=sendrecv",
+    "a=sendonly",
+    "a=recvonly",
+    "a=inactive",
+    "a=rtcp-mux",
+    "a=ice-options:google-ice",
+    "a=msid-semantic: WMS",
+    "a=setup:actpass",
+    "a=setup:active",
+    "a=setup:passive",
+    "a=mid:audio",
+    "a=mid:video",
+    "a=mid:data",
+    "a=group:BUNDLE audio video",
+    "a=group:BUNDLE audio video data",
+    "a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level",
+    "a=extmap:2 urn:ietf:params:rtp-hdrext:toffset",
+    "a=extmap:3 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+    "a=rtpmap:111 opus/48000/2",
+    "a=fmtp:111 minptime=10",
+    "a=rtpmap:103 ISAC/16000",
+    "a=rtpmap:104 ISAC/32000",
+    "a=rtpmap:0 PCMU/8000",
+    "a=rtpmap:8 PCMA/8000",
+    "a=rtpmap:106 CN/32000",
+    "a=rtpmap:105 CN/16000",
+    "a=rtpmap:13 CN/8000",
+    "a=rtpmap:126 telephone-event/8000",
+    "a=maxptime:60",
+    "a=rtpmap:100 VP8/90000",
+    "a=rtcp-fb:100 ccm fir",
+    "a=rtcp-fb:100 nack",
+    "a=rtcp-fb:100 nack pli",
+    "a=rtcp-fb:100 goog-remb",
+    "a=rtpmap:116 red/90000",
+    "a=rtpmap:117 ulpfec/90000",
+    "a=x-google-flag:conference",
+};
+
+// Prefixes of sdp lines, token is kPrefixToken + index. Longer ones first
+// when one is the prefix of another.
+static const char * const kSdpPrefixes[] = {
+    "a=candidate:",
+    "a=ssrc:",
+    "a=rtpmap:",
+    "a=fmtp:",
+    "a=rtcp-fb:",
+    "a=extmap:",
+    "a=crypto:1 AES_CM_128_HMAC_SHA1_80 inline:",
+    "a=crypto:",
+    "a=fingerprint:sha-256 ",
+    "a=ice-ufrag:",
+    "a=ice-pwd:",
+    "a=mid:",
+    "a=msid-semantic: WMS ",
+    "a=group:BUNDLE ",
+    "a=msid:",
+    "m=audio ",
+    "m=video ",
+    "m=application ",
+    "o=- ",
+    "c=IN IP4 ",
+    "a=rtcp:",
+    "a=sctpmap:",
+    "a=label:",
+    "b=AS:",
+};
+
+static const char * const kDescriptionTypes[] = {"offer", "pranswer", "answer"};
+static const char * const kProtocols[] = {"udp", "tcp", "ssltcp"};
+static const char * const kCandidateTypes[] = {"host", "srflx", "prflx", "relay"};
+
+#define ARRAY_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+//
+//> for writing
+static void PutVarint(uint64_t val, std::string &out)
+{
+    while (val >= 0x80) {
+        out += (char)(0x80 | (val & 0x7f));
+        val >>= 7;
+    }
+    out += (char)val;
+}
+
+static void PutString(const char *data, size_t len, std::string &out)
+{
+    PutVarint(len, out);
+    out.append(data, len);
+}
+
+static void PutString(const std::string &str, std::string &out)
+{
+    PutString(str.data(), str.size(), out);
+}
+
+// token of the word in table, or literal
+static void PutWord(const std::string &word, const char * const *table, size_t count, std::string &out)
+{
+    for (size_t k=0; k < count; k++) {
+        if (word == table[k]) {
+            out += (char)k;
+            return;
+        }
+    }
+    out += (char)kLiteralToken;
+    PutString(word, out);
+}
+
+static void PutMessage(int type, const std::string &payload, std::string &out)
+{
+    out.clear();
+    out.reserve(payload.size() + 8);
+    out += (char)kCompactMagic;
+    out += (char)((kCompactVersion << 4) | type);
+    PutVarint(payload.size(), out);
+    out += payload;
+}
+
+//
+//> for reading
+typedef struct _compact_reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    bool ok;
+
+    _compact_reader(const char *data, size_t len) 
+        : p((const unsigned char *)data), end((const unsigned char *)data + len), ok(true) {}
+
+    unsigned char Byte() {
+        if (p >= end) { ok = false; return 0; }
+        return *p++;
+    }
+    uint64_t Varint() {
+        uint64_t val = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            unsigned char ch = Byte();
+            if (!ok) return 0;
+            val |= (uint64_t)(ch & 0x7f) << shift;
+            if (!(ch & 0x80)) return val;
+        }
+        ok = false;
+        return 0;
+    }
+    void String(std::string &str) {
+        uint64_t len = Varint();
+        if (!ok || len > (uint64_t)(end - p)) { ok = false; return; }
+        str.assign((const char *)p, (size_t)len);
+        p += len;
+    }
+    void AppendString(std::string &str) {
+        uint64_t len = Varint();
+        if (!ok || len > (uint64_t)(end - p)) { ok = false; return; }
+        str.append((const char *)p, (size_t)len);
+        p += len;
+    }
+    void Word(const char * const *table, size_t count, std::string &word) {
+        unsigned char token = Byte();
+        if (token == kLiteralToken) String(word);
+        else if (token < count) word = table[token];
+        else ok = false;
+    }
+}compact_reader_t;
+
+static bool GetMessage(const char *data, size_t len, int &type, const char * &payload, size_t &payload_len)
+{
+    compact_reader_t reader(data, len);
+    if (reader.Byte() != kCompactMagic)
+        return false;
+    unsigned char head = reader.Byte();
+    if (!reader.ok || (head >> 4) != kCompactVersion)
+        return false;
+    type = head & 0x0f;
+    uint64_t size = reader.Varint();
+    if (!reader.ok || size != (uint64_t)(reader.end - reader.p))
+        return false;
+    payload = (const char *)reader.p;
+    payload_len = (size_t)size;
+    return true;
+}
+
+bool IsCompactSignaling(const char *data, size_t len)
+{
+    return (data && len > 0 && (unsigned char)data[0] == kCompactMagic);
+}
+
+//
+//> for description
+static void PutSdpLine(const char *line, size_t len, std::string &out)
+{
+    for (size_t k=0; k < ARRAY_COUNT(kSdpLines); k++) {
+        if (strlen(kSdpLines[k]) == len && memcmp(kSdpLines[k], line, len) == 0) {
+            out += (char)k;
+            return;
+        }
+    }
+    for (size_t k=0; k < ARRAY_COUNT(kSdpPrefixes); k++) {
+        size_t plen = strlen(kSdpPrefixes[k]);
+        if (plen <= len && memcmp(kSdpPrefixes[k], line, plen) == 0) {
+            out += (char)(kPrefixToken + k);
+            PutString(line + plen, len - plen, out);
+            return;
+        }
+    }
+    out += (char)kLiteralToken;
+    PutString(line, len, out);
+}
+
+static bool PutSdpLines(const std::string &sdp, std::string &out)
+{
+    std::string lines;
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < sdp.size()) {
+        size_t eol = sdp.find("\r\n", pos);
+        if (eol == std::string::npos)
+            return false;
+        PutSdpLine(sdp.data() + pos, eol - pos, lines);
+        count++;
+        pos = eol + 2;
+    }
+    PutVarint(count, out);
+    out += lines;
+    return true;
+}
+
+static bool GetSdpLines(compact_reader_t &reader, std::string &sdp)
+{
+    uint64_t count = reader.Varint();
+    for (uint64_t k=0; reader.ok && k < count; k++) {
+        unsigned char token = reader.Byte();
+        if (token == kLiteralToken) {
+            reader.AppendString(sdp);
+        }else if (token >= kPrefixToken) {
+            if ((size_t)(token - kPrefixToken) >= ARRAY_COUNT(kSdpPrefixes))
+                return false;
+            sdp += kSdpPrefixes[token - kPrefixToken];
+            reader.AppendString(sdp);
+        }else {
+            if (token >= ARRAY_COUNT(kSdpLines))
+                return false;
+            sdp += kSdpLines[token];
+        }
+        sdp += "\r\n";
+    }
+    return reader.ok;
+}
+
+static bool GetDescription(const char *data, size_t len, std::string &type, std::string &sdp)
+{
+    compact_reader_t reader(data, len);
+    reader.Word(kDescriptionTypes, ARRAY_COUNT(kDescriptionTypes), type);
+    unsigned char mode = reader.Byte();
+    sdp.clear();
+    if (mode == 0) {
+        GetSdpLines(reader, sdp);
+    }else if (mode == 1) {
+        reader.String(sdp);
+    }else {
+        return false;
+    }
+    return reader.ok && reader.p == reader.end;
+}
+
+bool EncodeCompactDescription(const std::string &type, const std::string &sdp, std::string &out)
+{
+    std::string payload;
+    payload.reserve(sdp.size() / 2);
+    PutWord(type, kDescriptionTypes, ARRAY_COUNT(kDescriptionTypes), payload);
+
+    // Re-render to make sure the lines form is equivalent, else keep it raw.
+    size_t head = payload.size();
+    payload += (char)0;
+    std::string rtype, rsdp;
+    if (!PutSdpLines(sdp, payload) || 
+        !GetDescription(payload.data(), payload.size(), rtype, rsdp) || rsdp != sdp) {
+        payload.resize(head);
+        payload += (char)1;
+        PutString(sdp, payload);
+    }
+
+    PutMessage(kDescriptionMessage, payload, out);
+    return true;
+}
+
+bool DecodeCompactDescription(const char *data, size_t len, std::string &type, std::string &sdp)
+{
+    int mtype = 0;
+    const char *payload = NULL;
+    size_t payload_len = 0;
+    returnb_assert(GetMessage(data, len, mtype, payload, payload_len));
+    returnb_assert(mtype == kDescriptionMessage);
+    return GetDescription(payload, payload_len, type, sdp);
+}
+
+//
+//> for candidate
+enum {
+    kCandidateTokenized = 0x01,
+    kCandidateRelated = 0x02,
+    kCandidateGeneration = 0x04,
+    kCandidateTail = 0x08,
+};
+
+static bool ParseNumber(const std::string &str, uint32_t &val)
+{
+    if (str.empty() || str.size() > 10)
+        return false;
+    uint64_t num = 0;
+    for (size_t k=0; k < str.size(); k++) {
+        if (str[k] < '0' || str[k] > '9')
+            return false;
+        num = num * 10 + (str[k] - '0');
+    }
+    if (num > 0xffffffffULL)
+        return false;
+    val = (uint32_t)num;
+    return true;
+}
+
+static void PutAddress(const std::string &addr, std::string &out)
+{
+    unsigned int a[4];
+    char tail;
+    if (sscanf(addr.c_str(), "%u.%u.%u.%u%c", &a[0], &a[1], &a[2], &a[3], &tail) == 4 &&
+        a[0] < 256 && a[1] < 256 && a[2] < 256 && a[3] < 256) {
+        out += (char)4;
+        for (int k=0; k < 4; k++)
+            out += (char)a[k];
+        return;
+    }
+    out += (char)0;
+    PutString(addr, out);
+}
+
+static void GetAddress(compact_reader_t &reader, std::string &sdp)
+{
+    unsigned char family = reader.Byte();
+    if (family == 4) {
+        char buf[16];
+        unsigned char a[4];
+        for (int k=0; k < 4; k++)
+            a[k] = reader.Byte();
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+        sdp += buf;
+    }else if (family == 0) {
+        reader.AppendString(sdp);
+    }else {
+        reader.ok = false;
+    }
+}
+
+static void AppendNumber(uint64_t val, std::string &sdp)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val);
+    sdp += buf;
+}
+
+// e.g. "candidate:4234997325 1 udp 2043278322 192.168.0.56 44323 typ host generation 0"
+static bool PutCandidateFields(const std::string &sdp, std::string &out)
+{
+    static const std::string kPrefix = "candidate:";
+    if (sdp.compare(0, kPrefix.size(), kPrefix) != 0)
+        return false;
+
+    std::vector<std::string> fields;
+    size_t pos = kPrefix.size();
+    while (pos <= sdp.size()) {
+        size_t sp = sdp.find(' ', pos);
+        if (sp == std::string::npos)
+            sp = sdp.size();
+        fields.push_back(sdp.substr(pos, sp - pos));
+        pos = sp + 1;
+    }
+    if (fields.size() < 8 || fields[6] != "typ")
+        return false;
+
+    uint32_t component, priority, port, rport = 0, generation = 0;
+    if (!ParseNumber(fields[1], component) || !ParseNumber(fields[3], priority) || !ParseNumber(fields[5], port))
+        return false;
+
+    size_t idx = 8;
+    unsigned char flags = kCandidateTokenized;
+    if (idx + 3 < fields.size() && fields[idx] == "raddr" && fields[idx + 2] == "rport") {
+        if (!ParseNumber(fields[idx + 3], rport))
+            return false;
+        flags |= kCandidateRelated;
+        idx += 4;
+    }
+    if (idx + 1 < fields.size() && fields[idx] == "generation") {
+        if (!ParseNumber(fields[idx + 1], generation))
+            return false;
+        flags |= kCandidateGeneration;
+        idx += 2;
+    }
+    std::string tail;
+    for (size_t k=idx; k < fields.size(); k++) {
+        if (k > idx)
+            tail += ' ';
+        tail += fields[k];
+    }
+    if (idx < fields.size())
+        flags |= kCandidateTail;
+
+    out += (char)flags;
+    PutString(fields[0], out);
+    PutVarint(component, out);
+    PutWord(fields[2], kProtocols, ARRAY_COUNT(kProtocols), out);
+    PutVarint(priority, out);
+    PutAddress(fields[4], out);
+    PutVarint(port, out);
+    PutWord(fields[7], kCandidateTypes, ARRAY_COUNT(kCandidateTypes), out);
+    if (flags & kCandidateRelated) {
+        PutAddress(fields[9], out);
+        PutVarint(rport, out);
+    }
+    if (flags & kCandidateGeneration)
+        PutVarint(generation, out);
+    if (flags & kCandidateTail)
+        PutString(tail, out);
+    return true;
+}
+
+static bool GetCandidateFields(compact_reader_t &reader, std::string &sdp)
+{
+    unsigned char flags = reader.Byte();
+    sdp.clear();
+    if (!(flags & kCandidateTokenized)) {
+        reader.String(sdp);
+        return reader.ok;
+    }
+
+    std::string word;
+    sdp += "candidate:";
+    reader.AppendString(sdp);
+    sdp += ' ';
+    AppendNumber(reader.Varint(), sdp);
+    sdp += ' ';
+    reader.Word(kProtocols, ARRAY_COUNT(kProtocols), word);
+    sdp += word;
+    sdp += ' ';
+    AppendNumber(reader.Varint(), sdp);
+    sdp += ' ';
+    GetAddress(reader, sdp);
+    sdp += ' ';
+    AppendNumber(reader.Varint(), sdp);
+    sdp += " typ ";
+    reader.Word(kCandidateTypes, ARRAY_COUNT(kCandidateTypes), word);
+    sdp += word;
+    if (flags & kCandidateRelated) {
+        sdp += " raddr ";
+        GetAddress(reader, sdp);
+        sdp += " rport ";
+        AppendNumber(reader.Varint(), sdp);
+    }
+    if (flags & kCandidateGeneration) {
+        sdp += " generation ";
+        AppendNumber(reader.Varint(), sdp);
+    }
+    if (flags & kCandidateTail) {
+        sdp += ' ';
+        reader.AppendString(sdp);
+    }
+    return reader.ok;
+}
+
+static bool GetCandidate(compact_reader_t &reader, compact_candidate_t &candidate)
+{
+    reader.String(candidate.mid);
+    uint64_t mline = reader.Varint();
+    if (!reader.ok || mline > (uint64_t)INT_MAX)
+        return false;
+    candidate.mline = (int)mline;
+    return GetCandidateFields(reader, candidate.sdp);
+}
+
+bool AppendCompactCandidate(const std::string &mid, int mline, const std::string &sdp, std::string &records)
+{
+    returnb_assert(mline >= 0);
+    PutString(mid, records);
+    PutVarint(mline, records);
+
+    // Re-render to make sure the tokens are equivalent, else keep it literal.
+    size_t head = records.size();
+    std::string rsdp;
+    bool tokenized = PutCandidateFields(sdp, records);
+    if (tokenized) {
+        compact_reader_t reader(records.data() + head, records.size() - head);
+        tokenized = GetCandidateFields(reader, rsdp) && reader.p == reader.end && rsdp == sdp;
+    }
+    if (!tokenized) {
+        records.resize(head);
+        records += (char)0;
+        PutString(sdp, records);
+    }
+    return true;
+}
+
+bool EncodeCompactCandidate(const std::string &mid, int mline, const std::string &sdp, std::string &out)
+{
+    std::string payload;
+    returnb_assert(AppendCompactCandidate(mid, mline, sdp, payload));
+    PutMessage(kCandidateMessage, payload, out);
+    return true;
+}
+
+void EncodeCompactCandidates(const std::string &records, int count, std::string &out)
+{
+    std::string payload;
+    payload.reserve(records.size() + 4);
+    PutVarint(count, payload);
+    payload += records;
+    PutMessage(kCandidatesMessage, payload, out);
+}
+
+bool DecodeCompactCandidates(const char *data, size_t len, std::vector<compact_candidate_t> &candidates)
+{
+    int mtype = 0;
+    const char *payload = NULL;
+    size_t payload_len = 0;
+    returnb_assert(GetMessage(data, len, mtype, payload, payload_len));
+
+    candidates.clear();
+    compact_reader_t reader(payload, payload_len);
+    uint64_t count = 1;
+    if (mtype == kCandidatesMessage) {
+        count = reader.Varint();
+    }else if (mtype != kCandidateMessage) {
+        return false;
+    }
+
+    for (uint64_t k=0; reader.ok && k < count; k++) {
+        compact_candidate_t candidate;
+        if (!GetCandidate(reader, candidate))
+            return false;
+        candidates.push_back(candidate);
+    }
+    return reader.ok && reader.p == reader.end;
+}
+
+} // namespace xrtc
@@ -0,0 +1,48 @@
+#ifndef _COMPACT_H_
+#define _COMPACT_H_
+
+#include <string>
+#include <vector>
+
+namespace xrtc {
+
+//
+//> for compact signaling
+// Binary alternative of the json signaling messages:
+//
+//  magic(0xB5) | version<<4 | message type | varint(payload length) | payload
+//
+//  description: type token, then sdp lines each of which is a dictionary
+//      line, a dictionary prefix plus the rest, or a literal. A sdp that
+//      would not render back byte-exact is kept raw instead.
+//  candidate: sdpMid, sdpMLineIndex, then candidate fields tokenized
+//      (component, protocol, priority, ipv4, port, type, ...), or literal
+//      when it would not render back byte-exact.
+//  candidates: count, then candidate payloads (for batching).
+//
+// The leading magic is not valid for json, so the input format is detected.
+
+typedef struct _compact_candidate {
+    std::string mid;
+    int mline;
+    std::string sdp;
+}compact_candidate_t;
+
+bool IsCompactSignaling(const char *data, size_t len);
+
+bool EncodeCompactDescription(const std::string &type, const std::string &sdp, std::string &out);
+bool DecodeCompactDescription(const char *data, size_t len, std::string &type, std::string &sdp);
+
+bool EncodeCompactCandidate(const std::string &mid, int mline, const std::string &sdp, std::string &out);
+
+// For batching: append candidates one by one, then wrap them into a message
+// The mline should not be negative, else the candidate is not appended.
+bool AppendCompactCandidate(const std::string &mid, int mline, const std::string &sdp, std::string &records);
+void EncodeCompactCandidates(const std::string &records, int count, std::string &out);
+
+// Accept both one candidate and a batch of candidates.
+bool DecodeCompactCandidates(const char *data, size_t len, std::vector<compact_candidate_t> &candidates);
+
+} // namespace xrtc
+
+#endif // _COMPACT_H_
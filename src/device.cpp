@@ -0,0 +1,239 @@
+#include "device.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+static ubase::Mutex _registry_mutex;
+static CDeviceRegistry * _registry = NULL;
+
+static bool IsSameDevices(const std::vector<cricket::Device> &devs1, const std::vector<cricket::Device> &devs2)
+{
+    if (devs1.size() != devs2.size())
+        return false;
+    for (size_t k=0; k < devs1.size(); k++) {
+        if (devs1[k].id != devs2[k].id || devs1[k].name != devs2[k].name)
+            return false;
+    }
+    return true;
+}
+
+CDeviceRegistry * CDeviceRegistry::Instance()
+{
+    ubase::ScopedLock lock(_registry_mutex);
+    if (!_registry) {
+        _registry = new CDeviceRegistry();
+        if (!_registry->Init()) {
+            LOGW("fail to init device registry");
+        }
+    }
+    return _registry;
+}
+
+CDeviceRegistry * CDeviceRegistry::Existing()
+{
+    ubase::ScopedLock lock(_registry_mutex);
+    return _registry;
+}
+
+void CDeviceRegistry::Cleanup()
+{
+    ubase::ScopedLock lock(_registry_mutex);
+    delete _registry;
+    _registry = NULL;
+}
+
+CDeviceRegistry::CDeviceRegistry()
+{
+    m_started = false;
+    m_inited = false;
+}
+
+CDeviceRegistry::~CDeviceRegistry()
+{
+    if (m_started) {
+        m_thread.Send(this, MSG_UNINIT);
+        m_thread.Stop();
+    }
+    m_observers.clear();
+}
+
+bool CDeviceRegistry::Init()
+{
+    // The device watcher is bound to the socket server of the thread
+    // where DeviceManager is initialized, so keep it in our own thread.
+    m_started = m_thread.Start();
+    returnb_assert(m_started);
+    m_thread.Send(this, MSG_INIT);
+    return m_inited;
+}
+
+std::vector<cricket::Device> * CDeviceRegistry::GetCache(int kind)
+{
+    switch(kind) {
+    case kVideoCapture: return &m_video_devices;
+    case kAudioIn:      return &m_audio_in_devices;
+    case kAudioOut:     return &m_audio_out_devices;
+    }
+    return NULL;
+}
+
+bool CDeviceRegistry::GetDevices(const device_kind_t kind, devices_t & devices)
+{
+    ubase::ScopedLock lock(m_mutex);
+    returnb_assert(m_inited);
+
+    std::vector<cricket::Device> *devs = GetCache(kind);
+    returnb_assert(devs);
+
+    device_t dev;
+    dev.kind = kind;
+    std::vector<cricket::Device>::const_iterator iter;
+    for (iter=devs->begin(); iter != devs->end(); ++iter) {
+        dev.did = (*iter).id;
+        dev.name = (*iter).name;
+        devices.push_back(dev);
+    }
+    return true;
+}
+
+cricket::VideoCapturer * CDeviceRegistry::CreateVideoCapturer(const std::string & did)
+{
+    // if did empty, select default device
+    cricket::Device device;
+    bool found = false;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        returnv_assert(m_inited, NULL);
+
+        std::vector<cricket::Device>::const_iterator iter;
+        for (iter=m_video_devices.begin(); iter != m_video_devices.end(); ++iter) {
+            if (did.empty() || (*iter).id == did || (*iter).name == did) {
+                device = *iter;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    ubase::ScopedLock lock(m_manager_mutex);
+    returnv_assert(m_manager.get(), NULL);
+
+    // e.g. file or yuv-frames capturer which is not enumerated
+    if (!found && !m_manager->GetVideoCaptureDevice(did, &device)) {
+        LOGW("fail to GetVideoCaptureDevice, did="<<did);
+        return NULL;
+    }
+    return m_manager->CreateVideoCapturer(device);
+}
+
+void CDeviceRegistry::AddObserver(DeviceChangeObserver *observer)
+{
+    return_assert(observer);
+    ubase::ScopedLock lock(m_mutex);
+    m_observers.push_back(observer);
+}
+
+void CDeviceRegistry::RemoveObserver(DeviceChangeObserver *observer)
+{
+    // wait for the notification in progress
+    ubase::ScopedLock dlock(m_dispatch_mutex);
+    ubase::ScopedLock lock(m_mutex);
+    std::vector<DeviceChangeObserver *>::iterator iter;
+    for (iter=m_observers.begin(); iter != m_observers.end(); ++iter) {
+        if (*iter == observer) {
+            m_observers.erase(iter);
+            break;
+        }
+    }
+}
+
+void CDeviceRegistry::OnMessage(talk_base::Message *msg)
+{
+    switch(msg->message_id) {
+    case MSG_INIT:
+        {
+            ubase::ScopedLock lock(m_manager_mutex);
+            m_manager.reset(cricket::DeviceManagerFactory::Create());
+            if (!m_manager->Init()) {
+                LOGW("fail to init DeviceManager");
+                m_manager.reset();
+                break;
+            }
+            m_manager->SignalDevicesChange.connect(this, &CDeviceRegistry::OnDevicesChange);
+        }
+        Refresh();
+        break;
+    case MSG_REFRESH:
+        Refresh();
+        break;
+    case MSG_UNINIT:
+        {
+            ubase::ScopedLock lock(m_mutex);
+            m_inited = false;
+        }
+        {
+            ubase::ScopedLock lock(m_manager_mutex);
+            if (m_manager.get()) {
+                m_manager->SignalDevicesChange.disconnect(this);
+                m_manager->Terminate();
+                m_manager.reset();
+            }
+        }
+        break;
+    }
+}
+
+void CDeviceRegistry::OnDevicesChange()
+{
+    // coalesce the burst of hotplug events into one rescan
+    m_thread.Clear(this, MSG_REFRESH);
+    m_thread.PostDelayed(100, this, MSG_REFRESH);
+}
+
+void CDeviceRegistry::Refresh()
+{
+    std::vector<cricket::Device> video_devices;
+    std::vector<cricket::Device> audio_in_devices;
+    std::vector<cricket::Device> audio_out_devices;
+    {
+        ubase::ScopedLock lock(m_manager_mutex);
+        return_assert(m_manager.get());
+        m_manager->GetVideoCaptureDevices(&video_devices);
+        m_manager->GetAudioInputDevices(&audio_in_devices);
+        m_manager->GetAudioOutputDevices(&audio_out_devices);
+    }
+
+    std::vector<int> kinds;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        if (m_inited) {
+            if (!IsSameDevices(m_video_devices, video_devices))
+                kinds.push_back(kVideoCapture);
+            if (!IsSameDevices(m_audio_in_devices, audio_in_devices))
+                kinds.push_back(kAudioIn);
+            if (!IsSameDevices(m_audio_out_devices, audio_out_devices))
+                kinds.push_back(kAudioOut);
+        }
+        m_video_devices.swap(video_devices);
+        m_audio_in_devices.swap(audio_in_devices);
+        m_audio_out_devices.swap(audio_out_devices);
+        m_inited = true;
+    }
+
+    // The observers are taken under the dispatch lock, so none is removed
+    //  during the notification.
+    ubase::ScopedLock dlock(m_dispatch_mutex);
+    std::vector<DeviceChangeObserver *> observers;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        observers = m_observers;
+    }
+    for (size_t k=0; k < kinds.size(); k++) {
+        LOGI("device changed, kind="<<kinds[k]);
+        for (size_t i=0; i < observers.size(); i++) {
+            observers[i]->OnDeviceChange(kinds[k]);
+        }
+    }
+}
+
+} // namespace xrtc
@@ -0,0 +1,71 @@
+#ifndef _DEVICE_H_
+#define _DEVICE_H_
+
+#include "webrtc.h"
+#include "talk/media/devices/devicemanager.h"
+#include "ubase/mutex.h"
+
+namespace xrtc {
+
+//
+//> for device change notification, called from the thread of CDeviceRegistry
+class DeviceChangeObserver {
+public:
+    virtual ~DeviceChangeObserver() {}
+
+    // @param kind: refer to device_kind_t
+    virtual void OnDeviceChange(int kind) = 0;
+};
+
+//
+//> for CDeviceRegistry
+// Process-wide cache of a/v devices, which is populated once and refreshed
+// when cricket::DeviceManager reports hotplug (udev on linux).
+class CDeviceRegistry : public talk_base::MessageHandler, public sigslot::has_slots<> {
+public:
+    static CDeviceRegistry * Instance();
+    // The registry if created, without creating it, e.g. after Cleanup.
+    static CDeviceRegistry * Existing();
+    static void Cleanup();
+
+    bool GetDevices(const device_kind_t kind, devices_t & devices);
+    cricket::VideoCapturer * CreateVideoCapturer(const std::string & did);
+
+    void AddObserver(DeviceChangeObserver *observer);
+    // No notification in progress for the observer after it returns.
+    void RemoveObserver(DeviceChangeObserver *observer);
+
+    // for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    enum {
+        MSG_INIT,
+        MSG_REFRESH,
+        MSG_UNINIT,
+    };
+
+    explicit CDeviceRegistry();
+    virtual ~CDeviceRegistry();
+
+    bool Init();
+    void Refresh();
+    void OnDevicesChange();
+    std::vector<cricket::Device> * GetCache(int kind);
+
+    talk_base::Thread m_thread;
+    talk_base::scoped_ptr<cricket::DeviceManagerInterface> m_manager;
+    bool m_started;
+    bool m_inited;
+    std::vector<cricket::Device> m_video_devices;
+    std::vector<cricket::Device> m_audio_in_devices;
+    std::vector<cricket::Device> m_audio_out_devices;
+    std::vector<DeviceChangeObserver *> m_observers;
+    ubase::Mutex m_mutex;
+    ubase::Mutex m_manager_mutex;   // for every use of m_manager
+    ubase::Mutex m_dispatch_mutex;  // held while notifying observers
+};
+
+} // namespace xrtc
+
+#endif // _DEVICE_H_
@@ -0,0 +1,205 @@
+#include <limits.h>
+#include <algorithm>
+
+#include "webrtc.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+// The default capture format when no size is constrained, the same as webrtc.
+static const int kDefaultWidth = 640;
+static const int kDefaultHeight = 480;
+static const int kDefaultFrameRate = 30;
+
+// Weights of each cost in the score of a capture format
+static const double kScaleWeight = 1.0;
+static const double kConvertWeight = 1.0;
+static const double kFrameRateWeight = 0.5;
+static const double kUnderSizeWeight = 0.5;
+
+//
+// The cost of converting a native pixel format into I420:
+//  0 for planar/semi-planar yuv, 1 for packed yuv, 2 for rgb and 4 for compressed.
+static int GetConvertCost(uint32 fourcc)
+{
+    switch (cricket::CanonicalFourCC(fourcc)) {
+    case cricket::FOURCC_I420:
+    case cricket::FOURCC_YV12:
+    case cricket::FOURCC_NV12:
+    case cricket::FOURCC_NV21:
+        return 0;
+    case cricket::FOURCC_YUY2:
+    case cricket::FOURCC_UYVY:
+        return 1;
+    case cricket::FOURCC_24BG:
+    case cricket::FOURCC_RAW:
+    case cricket::FOURCC_ARGB:
+    case cricket::FOURCC_BGRA:
+    case cricket::FOURCC_ABGR:
+        return 2;
+    case cricket::FOURCC_MJPG:
+    case cricket::FOURCC_H264:
+        return 4;
+    }
+    return 3;
+}
+
+static void GetRange(const constraint_t<range_t<int> > &constraint, int defval, int &min, int &max, bool &mandatory)
+{
+    if (constraint.valid) {
+        min = constraint.val.min;
+        max = constraint.val.max;
+        if (max <= 0) 
+            max = INT_MAX;
+        mandatory = !constraint.optional;
+    }else {
+        min = 0;
+        max = defval;
+        mandatory = false;
+    }
+}
+
+//
+// Score one native format against constraints, the lower the better.
+// @param strict: whether the mandatory maxima are rejected, or else only costs
+//      of downscaling.
+// @return false if the format violates any mandatory constraint.
+static bool ScoreCaptureFormat(const cricket::VideoFormat &format, const video_constraints_t *constraints, 
+        bool strict, double &score)
+{
+    int min_width, max_width, min_height, max_height, min_fps, max_fps;
+    bool mwidth = false, mheight = false, mfps = false;
+
+    if (constraints) {
+        GetRange(constraints->width, kDefaultWidth, min_width, max_width, mwidth);
+        GetRange(constraints->height, kDefaultHeight, min_height, max_height, mheight);
+        GetRange(constraints->frameRate, kDefaultFrameRate, min_fps, max_fps, mfps);
+    }else {
+        min_width = min_height = min_fps = 0;
+        max_width = kDefaultWidth;
+        max_height = kDefaultHeight;
+        max_fps = kDefaultFrameRate;
+    }
+
+    int fps = cricket::VideoFormat::IntervalToFps(format.interval);
+    if ((mwidth && format.width < min_width) || 
+        (mheight && format.height < min_height) || 
+        (mfps && fps < min_fps)) {
+        return false;
+    }
+    if (strict && ((mwidth && format.width > max_width) ||
+                   (mheight && format.height > max_height) ||
+                   (mfps && fps > max_fps))) {
+        return false;
+    }
+
+    double cost = 0;
+
+    // downscaling: proportional to the pixels thrown away
+    double width = (format.width > max_width) ? max_width : format.width;
+    double height = (format.height > max_height) ? max_height : format.height;
+    double pixels = (double)format.width * format.height;
+    double target = width * height;
+    if (pixels > target) {
+        cost += kScaleWeight * (pixels / target - 1);
+    }
+
+    // upscaling or smaller than wanted: prefer the largest format in range
+    if (format.width < min_width || format.height < min_height) {
+        cost += kScaleWeight * 4;
+    }else if (max_width != INT_MAX && max_height != INT_MAX) {
+        double wanted = (double)max_width * max_height;
+        if (pixels < wanted) {
+            cost += kUnderSizeWeight * (1 - pixels / wanted);
+        }
+    }
+
+    // pixel format conversion, e.g. MJPEG decode
+    cost += kConvertWeight * GetConvertCost(format.fourcc);
+
+    // frame rate: too low is bad, too high only costs dropping
+    if (fps < min_fps) {
+        cost += kFrameRateWeight * 4 * (min_fps - fps) / (double)min_fps;
+    }else if (fps > max_fps && max_fps > 0) {
+        cost += kFrameRateWeight * (fps - max_fps) / (double)max_fps;
+    }
+
+    score = cost;
+    return true;
+}
+
+bool SelectCaptureFormat(
+        const std::vector<cricket::VideoFormat> *formats, 
+        const video_constraints_t *constraints, 
+        cricket::VideoFormat &best)
+{
+    returnb_assert(formats);
+
+    // A format within the mandatory maxima if any, or else the one to be
+    // downscaled by the output format of track.
+    bool found = false;
+    double best_score = 0;
+    for (int strict = 1; strict >= 0 && !found; strict--) {
+        std::vector<cricket::VideoFormat>::const_iterator iter;
+        for (iter = formats->begin(); iter != formats->end(); iter++) {
+            double score = 0;
+            if (!ScoreCaptureFormat(*iter, constraints, strict != 0, score)) {
+                continue;
+            }
+            LOGD("capture format: "<<(*iter).ToString()<<", score="<<score);
+            if (!found || score < best_score) {
+                best = *iter;
+                best_score = score;
+                found = true;
+            }
+        }
+    }
+
+    if (found) {
+        LOGI("best capture format: "<<best.ToString()<<", score="<<best_score);
+    }
+    return found;
+}
+
+bool SelectOutputFormat(
+        const cricket::VideoFormat &capture, 
+        const video_constraints_t *constraints, 
+        cricket::VideoFormat &output)
+{
+    output = capture;
+    output.fourcc = cricket::FOURCC_ANY;
+    if (!constraints) {
+        return true;
+    }
+
+    int max_width = capture.width;
+    int max_height = capture.height;
+    if (constraints->width.valid) {
+        if (!constraints->width.optional && constraints->width.val.min > capture.width)
+            return false;
+        if (constraints->width.val.max > 0 && constraints->width.val.max < max_width)
+            max_width = constraints->width.val.max;
+    }
+    if (constraints->height.valid) {
+        if (!constraints->height.optional && constraints->height.val.min > capture.height)
+            return false;
+        if (constraints->height.val.max > 0 && constraints->height.val.max < max_height)
+            max_height = constraints->height.val.max;
+    }
+
+    // keep the aspect ratio of capture, and only downscale
+    if (capture.width > 0 && capture.height > 0) {
+        double scale = std::min((double)max_width / capture.width, (double)max_height / capture.height);
+        output.width = ((int)(capture.width * scale)) & ~1;
+        output.height = ((int)(capture.height * scale)) & ~1;
+    }
+
+    if (constraints->frameRate.valid && constraints->frameRate.val.max > 0) {
+        int fps = cricket::VideoFormat::IntervalToFps(capture.interval);
+        if (constraints->frameRate.val.max < fps)
+            output.interval = cricket::VideoFormat::FpsToInterval(constraints->frameRate.val.max);
+    }
+    return true;
+}
+
+} // namespace xrtc
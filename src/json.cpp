@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+CJsonWriter::CJsonWriter(std::string &out) : m_out(out), m_comma(false)
+{
+    m_out.clear();
+}
+
+void CJsonWriter::Reset()
+{
+    m_out.clear();
+    m_comma = false;
+}
+
+void CJsonWriter::BeginObject()
+{
+    if (m_comma)
+        m_out += ',';
+    m_out += '{';
+    m_comma = false;
+}
+
+void CJsonWriter::EndObject()
+{
+    m_out += '}';
+    m_comma = true;
+}
+
+void CJsonWriter::BeginArray()
+{
+    if (m_comma)
+        m_out += ',';
+    m_out += '[';
+    m_comma = false;
+}
+
+void CJsonWriter::EndArray()
+{
+    m_out += ']';
+    m_comma = true;
+}
+
+void CJsonWriter::AddKey(const char *key)
+{
+    if (m_comma)
+        m_out += ',';
+    m_out += '"';
+    m_out.append(key);
+    m_out += "\":";
+    m_comma = true;
+}
+
+void CJsonWriter::AddString(const char *key, const std::string &val)
+{
+    AddString(key, val.data(), val.size());
+}
+
+void CJsonWriter::AddString(const char *key, const char *val, size_t len)
+{
+    AddKey(key);
+    m_out += '"';
+    AddEscaped(val, len);
+    m_out += '"';
+}
+
+void CJsonWriter::AddInt(const char *key, int val)
+{
+    AddKey(key);
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", val);
+    m_out.append(buf, len);
+}
+
+// Copy the unescaped runs in one go, e.g. a sdp line between "\r\n"
+void CJsonWriter::AddEscaped(const char *val, size_t len)
+{
+    size_t begin = 0;
+    for (size_t k=0; k < len; k++) {
+        unsigned char ch = (unsigned char)val[k];
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+
+        m_out.append(val + begin, k - begin);
+        begin = k + 1;
+        switch (ch) {
+        case '"':  m_out += "\\\""; break;
+        case '\\': m_out += "\\\\"; break;
+        case '\r': m_out += "\\r"; break;
+        case '\n': m_out += "\\n"; break;
+        case '\t': m_out += "\\t"; break;
+        case '\b': m_out += "\\b"; break;
+        case '\f': m_out += "\\f"; break;
+        default: 
+            m_out += "\\u00";
+            m_out += kHexDigits[ch >> 4];
+            m_out += kHexDigits[ch & 0x0f];
+            break;
+        }
+    }
+    m_out.append(val + begin, len - begin);
+}
+
+//
+//> for CJsonReader
+static const char * SkipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    return p;
+}
+
+// p points to the char after the opening quote, return the closing quote or NULL
+static const char * ScanString(const char *p, const char *end, bool &escaped)
+{
+    escaped = false;
+    while (p < end) {
+        if (*p == '"')
+            return p;
+        if (*p == '\\') {
+            escaped = true;
+            p++;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// p points to '{' or '[', return the char after the matching one or NULL
+static const char * SkipNested(const char *p, const char *end)
+{
+    int depth = 0;
+    bool escaped;
+    while (p < end) {
+        switch (*p) {
+        case '{': 
+        case '[': 
+            depth++; 
+            break;
+        case '}': 
+        case ']': 
+            if (--depth == 0)
+                return p + 1;
+            break;
+        case '"':
+            p = ScanString(p + 1, end, escaped);
+            if (!p)
+                return NULL;
+            break;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+static int HexValue(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static bool ParseHex4(const char *p, const char *end, unsigned int &code)
+{
+    if (end - p < 4)
+        return false;
+    code = 0;
+    for (int k=0; k < 4; k++) {
+        int v = HexValue(p[k]);
+        if (v < 0)
+            return false;
+        code = (code << 4) | v;
+    }
+    return true;
+}
+
+static void AppendUtf8(unsigned int code, std::string &out)
+{
+    if (code < 0x80) {
+        out += (char)code;
+    }else if (code < 0x800) {
+        out += (char)(0xc0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3f));
+    }else if (code < 0x10000) {
+        out += (char)(0xe0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }else {
+        out += (char)(0xf0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3f));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+}
+
+CJsonReader::CJsonReader() : m_count(0)
+{
+}
+
+bool CJsonReader::Parse(const char *data, size_t len)
+{
+    m_count = 0;
+    if (!data)
+        return false;
+
+    const char *end = data + len;
+    const char *p = SkipSpace(data, end);
+    if (p >= end || *p != '{')
+        return false;
+    p = SkipSpace(p + 1, end);
+    if (p < end && *p == '}')
+        return true;
+
+    while (p < end) {
+        field_t field;
+        bool escaped;
+
+        // key
+        if (*p != '"')
+            return false;
+        field.key = p + 1;
+        p = ScanString(field.key, end, escaped);
+        if (!p)
+            return false;
+        field.key_len = p - field.key;
+
+        p = SkipSpace(p + 1, end);
+        if (p >= end || *p != ':')
+            return false;
+        p = SkipSpace(p + 1, end);
+        if (p >= end)
+            return false;
+
+        // value
+        field.escaped = false;
+        if (*p == '"') {
+            field.type = kStringValue;
+            field.val = p + 1;
+            p = ScanString(field.val, end, field.escaped);
+            if (!p)
+                return false;
+            field.val_len = p - field.val;
+            p++;
+        }else if (*p == '{' || *p == '[') {
+            field.type = kNestedValue;
+            field.val = p;
+            p = SkipNested(p, end);
+            if (!p)
+                return false;
+            field.val_len = p - field.val;
+        }else {
+            field.type = (*p == '-' || (*p >= '0' && *p <= '9')) ? kNumberValue : kLiteralValue;
+            field.val = p;
+            while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+                p++;
+            field.val_len = p - field.val;
+            if (field.val_len == 0)
+                return false;
+        }
+
+        if (m_count < kMaxFields)
+            m_fields[m_count++] = field;
+
+        p = SkipSpace(p, end);
+        if (p >= end)
+            return false;
+        if (*p == '}')
+            return true;
+        if (*p != ',')
+            return false;
+        p = SkipSpace(p + 1, end);
+    }
+    return false;
+}
+
+bool CJsonReader::SplitArray(const char *data, size_t len, std::vector<json_view_t> &items)
+{
+    items.clear();
+    returnb_assert(data);
+
+    const char *end = data + len;
+    const char *p = SkipSpace(data, end);
+    if (p >= end || *p != '[')
+        return false;
+    p = SkipSpace(p + 1, end);
+    if (p < end && *p == ']')
+        return true;
+
+    while (p < end) {
+        json_view_t item;
+        item.data = p;
+        if (*p == '{' || *p == '[') {
+            p = SkipNested(p, end);
+        }else if (*p == '"') {
+            bool escaped;
+            p = ScanString(p + 1, end, escaped);
+            if (p)
+                p++;
+        }else {
+            while (p < end && *p != ',' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+                p++;
+        }
+        if (!p || p == item.data)
+            return false;
+        item.len = p - item.data;
+        items.push_back(item);
+
+        p = SkipSpace(p, end);
+        if (p >= end)
+            return false;
+        if (*p == ']')
+            return true;
+        if (*p != ',')
+            return false;
+        p = SkipSpace(p + 1, end);
+    }
+    return false;
+}
+
+const CJsonReader::field_t * CJsonReader::Find(const char *key) const
+{
+    size_t len = strlen(key);
+    for (int k=0; k < m_count; k++) {
+        if (m_fields[k].key_len == len && memcmp(m_fields[k].key, key, len) == 0)
+            return &m_fields[k];
+    }
+    return NULL;
+}
+
+bool CJsonReader::HasKey(const char *key) const
+{
+    return Find(key) != NULL;
+}
+
+bool CJsonReader::GetString(const char *key, std::string &val) const
+{
+    const field_t *field = Find(key);
+    if (!field || field->type != kStringValue)
+        return false;
+    if (!field->escaped) {
+        val.assign(field->val, field->val_len);
+        return true;
+    }
+    return Unescape(field->val, field->val_len, val);
+}
+
+bool CJsonReader::GetInt(const char *key, int &val) const
+{
+    const field_t *field = Find(key);
+    if (!field || (field->type != kNumberValue && field->type != kStringValue))
+        return false;
+
+    char buf[16];
+    if (field->val_len == 0 || field->val_len >= sizeof(buf))
+        return false;
+    memcpy(buf, field->val, field->val_len);
+    buf[field->val_len] = 0;
+
+    char *stop = NULL;
+    long lval = strtol(buf, &stop, 10);
+    if (stop != buf + field->val_len)
+        return false;
+    val = (int)lval;
+    return true;
+}
+
+bool CJsonReader::Unescape(const char *val, size_t len, std::string &out)
+{
+    out.clear();
+    out.reserve(len);
+
+    const char *end = val + len;
+    const char *begin = val;
+    const char *p = val;
+    while (p < end) {
+        if (*p != '\\') {
+            p++;
+            continue;
+        }
+
+        out.append(begin, p - begin);
+        if (++p >= end)
+            return false;
+        switch (*p) {
+        case '"':  out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/':  out += '/'; break;
+        case 'b':  out += '\b'; break;
+        case 'f':  out += '\f'; break;
+        case 'n':  out += '\n'; break;
+        case 'r':  out += '\r'; break;
+        case 't':  out += '\t'; break;
+        case 'u': {
+            unsigned int code;
+            if (!ParseHex4(p + 1, end, code))
+                return false;
+            p += 4;
+            // surrogate pair
+            if (code >= 0xd800 && code <= 0xdbff) {
+                unsigned int low;
+                if (end - p < 7 || p[1] != '\\' || p[2] != 'u' || !ParseHex4(p + 3, end, low))
+                    return false;
+                if (low < 0xdc00 || low > 0xdfff)
+                    return false;
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            }
+            AppendUtf8(code, out);
+            break;
+        }
+        default:
+            return false;
+        }
+        p++;
+        begin = p;
+    }
+    out.append(begin, end - begin);
+    return true;
+}
+
+} // namespace xrtc
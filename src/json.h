@@ -0,0 +1,92 @@
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <string>
+#include <vector>
+
+namespace xrtc {
+
+//
+//> for CJsonWriter
+// Compact json writer for signaling messages, which appends directly into
+// the output string (cleared, so its capacity is reused) without any DOM
+// or whitespace. Keys are written as they are and must need no escaping.
+class CJsonWriter {
+public:
+    explicit CJsonWriter(std::string &out);
+
+    // clear the output to write a new message
+    void Reset();
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    void AddString(const char *key, const std::string &val);
+    void AddString(const char *key, const char *val, size_t len);
+    void AddInt(const char *key, int val);
+
+private:
+    void AddKey(const char *key);
+    void AddEscaped(const char *val, size_t len);
+
+    std::string &m_out;
+    bool m_comma;
+};
+
+// one value in a json buffer
+typedef struct _json_view {
+    const char *data;
+    size_t len;
+}json_view_t;
+
+//
+//> for CJsonReader
+// Incremental parser of one flat json object, e.g. a sdp or candidate
+// message. Values are kept as views into the input (which must outlive
+// the reader), and strings are unescaped only when fetched and escaped.
+// Nested objects and arrays are skipped.
+class CJsonReader {
+public:
+    explicit CJsonReader();
+
+    bool Parse(const char *data, size_t len);
+    bool Parse(const std::string &json) { return Parse(json.data(), json.size()); }
+
+    bool HasKey(const char *key) const;
+    bool GetString(const char *key, std::string &val) const;
+    bool GetInt(const char *key, int &val) const;
+
+    // Split a top-level json array into views of its items.
+    static bool SplitArray(const char *data, size_t len, std::vector<json_view_t> &items);
+
+private:
+    enum {
+        kMaxFields = 16,
+    };
+    enum value_t {
+        kStringValue,
+        kNumberValue,
+        kLiteralValue,
+        kNestedValue,
+    };
+    typedef struct _field {
+        const char *key;
+        size_t key_len;
+        const char *val;
+        size_t val_len;
+        value_t type;
+        bool escaped;
+    }field_t;
+
+    const field_t * Find(const char *key) const;
+    static bool Unescape(const char *val, size_t len, std::string &out);
+
+    field_t m_fields[kMaxFields];
+    int m_count;
+};
+
+} // namespace xrtc
+
+#endif // _JSON_H_
@@ -1,5 +1,9 @@
 #include "webrtc.h"
+#include "device.h"
+#include "overuse.h"
+#include "pool.h"
 #include "ubase/error.h"
+#include "ubase/mutex.h"
 
 class WebrtcRender : public webrtc::VideoRendererInterface {
 private:
@@ -69,20 +73,29 @@ virtual void RenderFrame(const cricket::VideoFrame* frame) {
 
 class CRtcCenter : public IRtcCenter, 
     public xrtc::NavigatorUserMediaCallback,
-    public xrtc::RTCPeerConnectionEventHandler
+    public xrtc::RTCPeerConnectionEventHandler,
+    public xrtc::DeviceChangeObserver
 {
 private:
     talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> m_pc_factory;
     ubase::zeroptr<xrtc::RTCPeerConnection> m_pc;
-    ubase::zeroptr<xrtc::MediaStream> m_local_stream;
+    ubase::zeroptr<xrtc::MediaStream> m_local_stream;   // set by the media thread
+    ubase::Mutex m_stream_mutex;
     IRtcSink *m_sink;
+    int m_batch_window_ms;
+    int m_batch_max_count;
+    int m_signaling_format;
+    sdp_policy_t m_sdp_policy;
+    bool m_has_sdp_policy;
     WebrtcRender *m_local_render;
     WebrtcRender *m_remote_render;
+    xrtc::CPeerConnectionPool *m_pc_pool;
 
 public:
 bool Init() {
     m_local_render = new WebrtcRender();
     m_remote_render = new WebrtcRender();
+    xrtc::CDeviceRegistry::Instance()->AddObserver((xrtc::DeviceChangeObserver *)this);
     return true;
 }
 
@@ -92,13 +105,28 @@ CRtcCenter() {
     m_local_stream = NULL;
 
     m_sink = NULL;
+    m_batch_window_ms = 0;
+    m_batch_max_count = 0;
+    m_signaling_format = kJsonSignaling;
+    m_has_sdp_policy = false;
     m_local_render = NULL;
     m_remote_render = NULL;       
+    m_pc_pool = NULL;
 }
 
 virtual ~CRtcCenter() {
+    // not to create the registry again after xrtc_uninit
+    xrtc::CDeviceRegistry *registry = xrtc::CDeviceRegistry::Existing();
+    if (registry) {
+        registry->RemoveObserver((xrtc::DeviceChangeObserver *)this);
+    }
+    xrtc::CancelUserMedia((xrtc::NavigatorUserMediaCallback *)this);
+    if (GetLocalStream().get()) {
+        SetAdaptedTracks(false);
+    }
     delete m_local_render;
     delete m_remote_render;
+    delete m_pc_pool;
 }
 
 //
@@ -114,17 +142,20 @@ virtual void GetDevices(const device_kind_t kind, devices_t & devices)
 }
 
 virtual long GetUserMedia(const media_constraints_t & media_constraints) {
-    talk_base::Thread *worker_thread = talk_base::Thread::Current();
-    talk_base::Thread *signal_thread = talk_base::Thread::Current(); 
+    // The factory owns its worker/signaling threads, for tracks are opened in background.
     talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory = NULL;
-
-    pc_factory = webrtc::CreatePeerConnectionFactory(worker_thread, signal_thread, NULL, NULL, NULL);
+    pc_factory = xrtc::CreatePeerConnectionFactory();
     returnv_assert (pc_factory.get(), UBASE_E_FAIL);
 
+    xrtc::CancelUserMedia((xrtc::NavigatorUserMediaCallback *)this);
     xrtc::GetUserMedia(media_constraints, (xrtc::NavigatorUserMediaCallback *)this, pc_factory);
     return UBASE_S_OK;
 }
 
+virtual void CancelUserMedia() {
+    xrtc::CancelUserMedia((xrtc::NavigatorUserMediaCallback *)this);
+}
+
 virtual long CreatePeerConnection() {
     ice_server_t server;
     server.uri = xrtc::kDefaultIceServer; // default google stun server
@@ -135,35 +166,83 @@ virtual long CreatePeerConnection() {
 }
 
 virtual long CreatePeerConnection(const ice_servers_t & ice_servers) {
-    m_pc_factory = webrtc::CreatePeerConnectionFactory();
-    returnv_assert (m_pc_factory.get(), UBASE_E_FAIL);
+    rtc_config_t config;
+    return CreatePeerConnection(ice_servers, config);
+}
 
-    webrtc::PeerConnectionInterface::IceServers servers;
+virtual long CreatePeerConnection(const ice_servers_t & ice_servers, const rtc_config_t & config) {
+    returnv_assert (config.ice_candidate_pool_size >= 0, UBASE_E_INVALIDARG);
 
-    ice_servers_t::const_iterator iter;
-    for (iter = ice_servers.begin(); iter != ice_servers.end(); iter++) {
-        webrtc::PeerConnectionInterface::IceServer server;
-        server.uri = iter->uri;
-        server.username = iter->username;
-        server.password = iter->password;
-        servers.push_back(server);
+    m_pc_factory = NULL;
+    m_pc = NULL;
+    if (m_pc_pool) {
+        m_pc_pool->Take(ice_servers, config, m_pc_factory, m_pc);
     }
 
-    m_pc = xrtc::CreatePeerConnection(servers, m_pc_factory);
-    returnv_assert (m_pc.get(), UBASE_E_FAIL);
+    if (!m_pc.get()) {
+        m_pc_factory = xrtc::CreatePeerConnectionFactory();
+        returnv_assert (m_pc_factory.get(), UBASE_E_FAIL);
+
+        webrtc::PeerConnectionInterface::IceServers servers;
+        xrtc::Convert2IceServers(ice_servers, servers);
+        m_pc = xrtc::CreatePeerConnection(servers, config, m_pc_factory);
+        returnv_assert (m_pc.get(), UBASE_E_FAIL);
+    }
     m_pc->Put_EventHandler((xrtc::RTCPeerConnectionEventHandler *)this);
+    m_pc->setCandidateBatching(m_batch_window_ms, m_batch_max_count);
+    m_pc->setSignalingFormat(m_signaling_format);
+    if (m_has_sdp_policy) {
+        m_pc->setSdpPolicy(m_sdp_policy);
+    }
     return UBASE_S_OK;
 }
 
+virtual void SetPeerConnectionPool(int size, const ice_servers_t & ice_servers, const rtc_config_t & config) {
+    ice_servers_t servers = ice_servers;
+    if (servers.empty()) {
+        ice_server_t server;
+        server.uri = xrtc::kDefaultIceServer; // the same as CreatePeerConnection()
+        servers.push_back(server);
+    }
+
+    if (!m_pc_pool) {
+        if (size <= 0)
+            return;
+        m_pc_pool = new xrtc::CPeerConnectionPool();
+    }
+    m_pc_pool->SetConfig(size, servers, config);
+}
+
 virtual long AddLocalStream() { 
-    returnv_assert (m_local_stream.get(), UBASE_E_INVALIDPTR);
+    ubase::zeroptr<xrtc::MediaStream> stream = GetLocalStream();
+    returnv_assert (stream.get(), UBASE_E_INVALIDPTR);
     returnv_assert (m_pc.get(), UBASE_E_INVALIDPTR);
 
     xrtc::MediaConstraints constraints;
-    m_pc->addStream(m_local_stream, constraints);
+    m_pc->addStream(stream, constraints);
+    SetAdaptedTracks(true);
     return UBASE_S_OK;
 }
 
+// intenal implemention
+ubase::zeroptr<xrtc::MediaStream> GetLocalStream() {
+    ubase::ScopedLock lock(m_stream_mutex);
+    return m_local_stream;
+}
+
+// intenal implemention
+void SetAdaptedTracks(bool adapted) {
+    ubase::zeroptr<xrtc::MediaStream> stream = GetLocalStream();
+    return_assert (stream.get());
+    sequence<xrtc::MediaStreamTrackPtr> tracks = stream->getVideoTracks();
+    for (size_t k=0; k < tracks.size(); k++) {
+        if (adapted)
+            xrtc::COveruseDetector::Instance()->AddTrack(tracks[k]);
+        else
+            xrtc::COveruseDetector::Instance()->RemoveTrack(tracks[k]);
+    }
+}
+
 // intenal implemention
 long AddRender(sequence<xrtc::MediaStreamPtr> streams, WebrtcRender *render) {
     returnv_assert (!streams.empty(), UBASE_E_FAIL);
@@ -244,6 +323,14 @@ virtual long AnswerCall() {
     return UBASE_S_OK;
 }
 
+virtual long RestartIce() {
+    returnv_assert (m_pc.get(), UBASE_E_INVALIDPTR);
+    xrtc::RTCConfiguration configuration;
+    xrtc::MediaConstraints constraints;
+    m_pc->updateIce(configuration, constraints);
+    return UBASE_S_OK;
+}
+
 virtual long SetLocalDescription(const std::string &sdp) {
     returnv_assert (m_pc.get(), UBASE_E_INVALIDPTR);
     m_pc->setLocalDescription(sdp);
@@ -262,20 +349,86 @@ virtual long AddIceCandidate(const std::string &candidate) {
     return UBASE_S_OK;
 }
 
+virtual void SetCandidateBatching(int window_ms, int max_count) {
+    m_batch_window_ms = window_ms;
+    m_batch_max_count = max_count;
+    if (m_pc.get()) {
+        m_pc->setCandidateBatching(window_ms, max_count);
+    }
+}
+
+virtual void SetSignalingFormat(int format) {
+    m_signaling_format = format;
+    if (m_pc.get()) {
+        m_pc->setSignalingFormat(format);
+    }
+}
+
+virtual void SetSdpPolicy(const sdp_policy_t &policy) {
+    m_sdp_policy = policy;
+    m_has_sdp_policy = true;
+    if (m_pc.get()) {
+        m_pc->setSdpPolicy(policy);
+    }
+}
+
+virtual long SetAdaptation(const adaptation_config_t &config) {
+    returnv_assert (config.overuse_ms > config.underuse_ms, UBASE_E_INVALIDARG);
+    for (size_t k=0; k < config.ladder.size(); k++) {
+        returnv_assert (config.ladder[k].scale > 0 && config.ladder[k].scale <= 100, UBASE_E_INVALIDARG);
+    }
+    xrtc::COveruseDetector::Instance()->SetConfig(config);
+    return UBASE_S_OK;
+}
+
+virtual void GetAdaptation(adaptation_state_t &state) {
+    xrtc::COveruseDetector::Instance()->GetState(state);
+}
+
+virtual long SetEncoderThreads(int max_threads) {
+    returnv_assert (max_threads >= 0, UBASE_E_INVALIDARG);
+#ifdef WEBRTC_H264
+    webrtc::H264Encoder::SetMaxThreads(max_threads);
+    return UBASE_S_OK;
+#else
+    return UBASE_E_UNIMPL;
+#endif
+}
+
+virtual long SetTemporalLayers(int layers) {
+    returnv_assert (layers >= 1 && layers <= 3, UBASE_E_INVALIDARG);
+#ifdef WEBRTC_H264
+    webrtc::H264Encoder::SetTemporalLayers(layers);
+    return UBASE_S_OK;
+#else
+    return UBASE_E_UNIMPL;
+#endif
+}
+
 virtual void Close() {
+    xrtc::CancelUserMedia((xrtc::NavigatorUserMediaCallback *)this);
     if (m_pc.get()) {
         m_pc->close();
         m_pc = NULL;
     }
     m_pc_factory = NULL;
-    m_local_stream = NULL;
+    if (GetLocalStream().get()) {
+        SetAdaptedTracks(false);
+    }
+    {
+        ubase::ScopedLock lock(m_stream_mutex);
+        m_local_stream = NULL;
+    }
 }
 
 //
 // For xrtc::NavigatorUserMediaCallback
 virtual void SuccessCallback(xrtc::MediaStreamPtr stream)         {
     return_assert(m_sink);
-    m_local_stream = stream;
+    {
+        ubase::ScopedLock lock(m_stream_mutex);
+        m_local_stream = stream;
+    }
 #if defined(OBJC)
     [m_sink OnGetUserMedia:UBASE_S_OK errstr:""];
 #else
@@ -349,6 +502,28 @@ virtual void onfailure(const xrtc::DOMString &error) {
     m_sink->OnFailure(error);
 #endif
 
+}
+virtual void onsetlocaldescription(const xrtc::DOMString &error, long elapsed_us) {
+    return_assert(m_sink);
+    int code = error.empty() ? UBASE_S_OK : UBASE_E_FAIL;
+#if defined(OBJC)
+    if ([m_sink respondsToSelector:@selector(OnSetLocalDescription:errstr:elapsed:)]) {
+        [m_sink OnSetLocalDescription:code errstr:error elapsed:elapsed_us];
+    }
+#else
+    m_sink->OnSetLocalDescription(code, error, elapsed_us);
+#endif
+}
+virtual void onsetremotedescription(const xrtc::DOMString &error, long elapsed_us) {
+    return_assert(m_sink);
+    int code = error.empty() ? UBASE_S_OK : UBASE_E_FAIL;
+#if defined(OBJC)
+    if ([m_sink respondsToSelector:@selector(OnSetRemoteDescription:errstr:elapsed:)]) {
+        [m_sink OnSetRemoteDescription:code errstr:error elapsed:elapsed_us];
+    }
+#else
+    m_sink->OnSetRemoteDescription(code, error, elapsed_us);
+#endif
 }
 virtual void onerror() {
     return_assert(m_sink);
@@ -360,6 +535,19 @@ virtual void onerror() {
 
 }
 
+//
+// For xrtc::DeviceChangeObserver
+virtual void OnDeviceChange(int kind) {
+    return_assert(m_sink);
+#if defined(OBJC)
+    if ([m_sink respondsToSelector:@selector(OnDeviceChange:)]) {
+        [m_sink OnDeviceChange:kind];
+    }
+#else
+    m_sink->OnDeviceChange(kind);
+#endif
+}
+
 };
 
 
@@ -376,6 +564,10 @@ bool xrtc_init()
 
 void xrtc_uninit()
 {
+    xrtc::CleanupUserMedia();
+    xrtc::CDeviceRegistry::Cleanup();
+    xrtc::COveruseDetector::Cleanup();
+    xrtc::CleanupPeerConnectionFactory();
     talk_base::CleanupSSL();
 }
 
@@ -25,58 +25,272 @@
 #include "xrtc_std.h"
 #include "webrtc.h"
 #include "ubase/error.h"
-
-static talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _pc_factory;
+#include "ubase/mutex.h"
 
 namespace xrtc {
 
-void NavigatorUserMedia::getUserMedia (const MediaStreamConstraints & constraints, NavigatorUserMediaCallback *sink)
+//
+//> for CUserMediaRequest
+// One pending getUserMedia: audio and video tracks are opened in parallel on
+// two background threads, and the last one finished returns the stream.
+class CUserMediaRequest : public talk_base::MessageHandler, public ubase::RefCount {
+public:
+    enum {
+        MSG_OPEN_AUDIO = XRTC_AUDIO,
+        MSG_OPEN_VIDEO = XRTC_VIDEO,
+    };
+
+private:
+    talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> m_pc_factory;
+    NavigatorUserMediaCallback *m_sink;
+    MediaTrackConstraints m_audio_constraints;
+    MediaTrackConstraints m_video_constraints;
+    ubase::zeroptr<MediaStreamTrack> m_audio_track;
+    ubase::zeroptr<MediaStreamTrack> m_video_track;
+    bool m_has_audio;
+    bool m_has_video;
+    bool m_cancelled;
+    volatile ubase::atomic::cas_t m_pending;
+    ubase::Mutex m_mutex;
+    ubase::Mutex m_callback_mutex;  // held while calling the sink
+
+public:
+    explicit CUserMediaRequest(NavigatorUserMediaCallback *sink);
+    virtual ~CUserMediaRequest();
+
+    bool Init(const MediaStreamConstraints & constraints, 
+            talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory);
+    void Start();
+    void Cancel();
+    NavigatorUserMediaCallback *sink() { return m_sink; }
+
+    // for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    void Complete();
+    void Deliver();
+};
+
+static ubase::Mutex _media_mutex;
+static talk_base::Thread *_media_threads[2] = {NULL, NULL};
+static sequence<ubase::zeroptr<CUserMediaRequest> > _media_requests;
+
+static talk_base::Thread * GetMediaThread(media_t mtype)
 {
-    return_assert(sink);
-    return_assert(_pc_factory.get());
+    int idx = (mtype == XRTC_AUDIO) ? 0 : 1;
+    ubase::ScopedLock lock(_media_mutex);
+    if (!_media_threads[idx]) {
+        _media_threads[idx] = new talk_base::Thread();
+        _media_threads[idx]->Start();
+    }
+    return _media_threads[idx];
+}
+
+static void RemoveMediaRequest(CUserMediaRequest *request)
+{
+    ubase::ScopedLock lock(_media_mutex);
+    sequence<ubase::zeroptr<CUserMediaRequest> >::iterator iter;
+    for (iter = _media_requests.begin(); iter != _media_requests.end(); iter++) {
+        if ((*iter).get() == request) {
+            _media_requests.erase(iter);
+            break;
+        }
+    }
+}
+
+CUserMediaRequest::CUserMediaRequest(NavigatorUserMediaCallback *sink)
+{
+    m_pc_factory = NULL;
+    m_sink = sink;
+    m_has_audio = false;
+    m_has_video = false;
+    m_cancelled = false;
+    m_pending = 0;
+}
 
+CUserMediaRequest::~CUserMediaRequest()
+{
+    m_audio_track = NULL;
+    m_video_track = NULL;
+    m_pc_factory = NULL;
+}
+
+bool CUserMediaRequest::Init(const MediaStreamConstraints & constraints, 
+        talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory)
+{
+    returnb_assert(pc_factory.get());
+    m_pc_factory = pc_factory;
+    m_has_audio = constraints.has_audio;
+    m_has_video = constraints.has_video;
+
+    // The only copy in getUserMedia, they are moved into tracks later.
+    if (m_has_audio)
+        m_audio_constraints = constraints.audio;
+    if (m_has_video)
+        m_video_constraints = constraints.video;
+    return true;
+}
+
+void CUserMediaRequest::Start()
+{
+    // one extra count for Start itself, so that the stream is returned
+    // only after both tracks have been posted (or none is requested).
+    m_pending = 1;
+    if (m_has_audio) {
+        ubase::atomic::inc(&m_pending);
+        AddRef();
+        GetMediaThread(XRTC_AUDIO)->Post(this, MSG_OPEN_AUDIO);
+    }
+    if (m_has_video) {
+        ubase::atomic::inc(&m_pending);
+        AddRef();
+        GetMediaThread(XRTC_VIDEO)->Post(this, MSG_OPEN_VIDEO);
+    }
+    if (ubase::atomic::dec(&m_pending) == 0) {
+        Complete();
+    }
+}
+
+void CUserMediaRequest::Cancel()
+{
+    {
+        ubase::ScopedLock lock(m_mutex);
+        m_cancelled = true;
+    }
+    // Wait for the callback in progress if any, no callback after this.
+    ubase::ScopedLock clock(m_callback_mutex);
+}
+
+void CUserMediaRequest::OnMessage(talk_base::Message *msg)
+{
+    bool cancelled = false;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        cancelled = m_cancelled;
+    }
+
+    if (!cancelled) {
+        switch(msg->message_id) {
+        case MSG_OPEN_AUDIO:
+            LOGD("get audio track in background");
+            m_audio_track = CreateMediaStreamTrack(XRTC_AUDIO, kAudioLabel, &m_audio_constraints, m_pc_factory, NULL);
+            break;
+        case MSG_OPEN_VIDEO:
+            LOGD("get video track in background");
+            m_video_track = CreateMediaStreamTrack(XRTC_VIDEO, kVideoLabel, &m_video_constraints, m_pc_factory, NULL);
+            break;
+        }
+    }
+
+    if (ubase::atomic::dec(&m_pending) == 0) {
+        Complete();
+    }
+    Release();
+}
+
+void CUserMediaRequest::Complete()
+{
+    ubase::zeroptr<CUserMediaRequest> hold = this;
+
+    // The callback lock is taken before deciding, so that a concurrent Cancel
+    // either wins or waits for the callback. The sink is called without
+    // m_mutex, and after leaving the list.
+    ubase::ScopedLock clock(m_callback_mutex);
+    {
+        ubase::ScopedLock lock(m_mutex);
+        if (m_cancelled) {
+            LOGI("getUserMedia cancelled, drop a/v tracks");
+            return;
+        }
+        m_cancelled = true;
+    }
+    RemoveMediaRequest(this);
+    Deliver();
+}
+
+void CUserMediaRequest::Deliver()
+{
     NavigatorUserMediaError error;
+    ubase::zeroptr<MediaStream> stream = CreateMediaStream(kLocalStreamLabel, m_pc_factory, NULL);
+    if (!stream.get()) {
+        error.errstr = "no local stream";
+        m_sink->ErrorCallback(error);
+        return;
+    }
 
-    std::string slabel = kLocalStreamLabel;
-    ubase::zeroptr<MediaStream> stream = CreateMediaStream(slabel, _pc_factory, NULL);
-    return_assert(stream.get());
-    
     // for audio track
-    if (constraints.has_audio) {
-        LOGD("get audio track and add it to stream");
-        std::string alabel = kAudioLabel;
-        MediaTrackConstraints audio_constraints(constraints.audio);
-        
-        ubase::zeroptr<MediaStreamTrack> audio_track =
-            CreateMediaStreamTrack(XRTC_AUDIO, alabel, &audio_constraints, _pc_factory, NULL);
-        if (audio_track->getptr() == NULL) {
+    if (m_has_audio) {
+        if (!m_audio_track.get() || m_audio_track->getptr() == NULL) {
             LOGW("fail to get audio track")
             error.errstr = "no audio track";
-            sink->ErrorCallback(error);
+            m_sink->ErrorCallback(error);
         }else {
-            stream->addTrack(audio_track);
+            stream->addTrack(m_audio_track);
         }
     }
 
     // for video track
-    if (constraints.has_video) {
-        LOGD("get video track and add it to stream");
-        std::string vlabel = kVideoLabel;
-        MediaTrackConstraints video_constraints(constraints.video);
-        
-        ubase::zeroptr<MediaStreamTrack> video_track =
-            CreateMediaStreamTrack(XRTC_VIDEO, vlabel, &video_constraints, _pc_factory, NULL);
-        if (video_track->getptr() == NULL) {
+    if (m_has_video) {
+        if (!m_video_track.get() || m_video_track->getptr() == NULL) {
             LOGW("fail to get video track")
             error.errstr = "no video track";
-            sink->ErrorCallback(error);
+            m_sink->ErrorCallback(error);
         }else {
-            stream->addTrack(video_track);
+            stream->addTrack(m_video_track);
         }
     }
 
     LOGD("return a/v stream")
-    sink->SuccessCallback(stream);
+    m_sink->SuccessCallback(stream);
+}
+
+
+//
+//> for NavigatorUserMedia
+static talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _pc_factory;
+
+void NavigatorUserMedia::getUserMedia (const MediaStreamConstraints & constraints, NavigatorUserMediaCallback *sink)
+{
+    return_assert(sink);
+    return_assert(_pc_factory.get());
+
+    ubase::zeroptr<CUserMediaRequest> request = new ubase::RefCounted<CUserMediaRequest>(sink);
+    if (!request->Init(constraints, _pc_factory)) {
+        NavigatorUserMediaError error;
+        error.errstr = "invalid request";
+        sink->ErrorCallback(error);
+        return;
+    }
+
+    {
+        ubase::ScopedLock lock(_media_mutex);
+        _media_requests.push_back(request);
+    }
+    request->Start();
+}
+
+void NavigatorUserMedia::cancelUserMedia (NavigatorUserMediaCallback *sink)
+{
+    return_assert(sink);
+
+    sequence<ubase::zeroptr<CUserMediaRequest> > requests;
+    {
+        ubase::ScopedLock lock(_media_mutex);
+        sequence<ubase::zeroptr<CUserMediaRequest> >::iterator iter = _media_requests.begin();
+        while (iter != _media_requests.end()) {
+            if ((*iter)->sink() == sink) {
+                requests.push_back(*iter);
+                iter = _media_requests.erase(iter);
+            }else {
+                iter++;
+            }
+        }
+    }
+
+    for (size_t k=0; k < requests.size(); k++) {
+        requests[k]->Cancel();
+    }
 }
 
 void GetUserMedia(
@@ -89,5 +303,42 @@ void GetUserMedia(
     _pc_factory = NULL;
 }
 
-} //namespace xrtc
+void CancelUserMedia(NavigatorUserMediaCallback *sink)
+{
+    NavigatorUserMedia::cancelUserMedia(sink);
+}
 
+void CleanupUserMedia()
+{
+    talk_base::Thread *threads[2] = {NULL, NULL};
+    sequence<ubase::zeroptr<CUserMediaRequest> > requests;
+    {
+        ubase::ScopedLock lock(_media_mutex);
+        for (int k=0; k < 2; k++) {
+            threads[k] = _media_threads[k];
+            _media_threads[k] = NULL;
+        }
+        requests.swap(_media_requests);
+    }
+
+    // without _media_mutex, which Complete takes after the request's locks
+    for (size_t k=0; k < requests.size(); k++) {
+        requests[k]->Cancel();
+    }
+
+    for (int k=0; k < 2; k++) {
+        if (threads[k]) {
+            threads[k]->Stop();
+            // the reference of each message dropped by Stop
+            talk_base::MessageList removed;
+            threads[k]->Clear(NULL, talk_base::MQID_ANY, &removed);
+            talk_base::MessageList::iterator iter;
+            for (iter = removed.begin(); iter != removed.end(); iter++) {
+                static_cast<CUserMediaRequest *>((*iter).phandler)->Release();
+            }
+            delete threads[k];
+        }
+    }
+}
+
+} //namespace xrtc
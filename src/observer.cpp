@@ -1,5 +1,6 @@
 #include "observer.h"
 #include "peer.h"
+#include "compact.h"
 #include "ubase/error.h"
 
 namespace xrtc {
@@ -12,10 +13,17 @@ bool CRTCPeerConnectionObserver::Init(ubase::zeroptr<CRTCPeerConnection> pc,
     return ((m_pc.get() != NULL) && (m_conn.get() != NULL));
 }
 
-CRTCPeerConnectionObserver::CRTCPeerConnectionObserver() 
+CRTCPeerConnectionObserver::CRTCPeerConnectionObserver() : m_batch_writer(m_batch)
 {
     m_pc = NULL;
     m_conn = NULL;
+    m_format = kJsonSignaling;
+    m_has_policy = false;
+    m_batch_window_ms = 0;
+    m_batch_max_count = 0;
+    m_batch_format = kJsonSignaling;
+    m_batch_count = 0;
+    m_batch_thread = NULL;
 }
 
 CRTCPeerConnectionObserver::~CRTCPeerConnectionObserver()
@@ -24,6 +32,26 @@ CRTCPeerConnectionObserver::~CRTCPeerConnectionObserver()
     m_conn = NULL;
 }
 
+void CRTCPeerConnectionObserver::SetCandidateBatching(int window_ms, int max_count)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_batch_window_ms = (window_ms > 0) ? window_ms : 0;
+    m_batch_max_count = (max_count > 0) ? max_count : 0;
+}
+
+void CRTCPeerConnectionObserver::SetSignalingFormat(int format)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_format = format;
+}
+
+void CRTCPeerConnectionObserver::SetSdpPolicy(const sdp_policy_t &policy)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_policy = policy;
+    m_has_policy = true;
+}
+
 ///
 /// for webrtc::PeerConnectionObserver
 void CRTCPeerConnectionObserver::OnError() 
@@ -92,6 +120,9 @@ void CRTCPeerConnectionObserver::OnIceGatheringChange(
         webrtc::PeerConnectionInterface::IceGatheringState new_state) 
 {
     LOGD("from webrtc::PeerConnectionObserver, new_state="<<new_state);
+    if (new_state == webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+        FlushCandidates();
+    }
 }
 
 // New Ice candidate have been found.
@@ -99,9 +130,85 @@ void CRTCPeerConnectionObserver::OnIceCandidate(const webrtc::IceCandidateInterf
 {
     return_assert (candidate);
     
-    std::string json;
-    if (Convert2Json(candidate, json)) {
-        event_process1(m_pc, onicecandidate, json);
+    int window_ms, max_count, format;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        window_ms = m_batch_window_ms;
+        max_count = m_batch_max_count;
+        format = m_format;
+    }
+
+    if (window_ms == 0 && m_batch_count == 0) {
+        bool bret = false;
+        if (format == kBinarySignaling)
+            bret = Convert2Compact(candidate, m_json);
+        else
+            bret = Convert2Json(candidate, m_json);
+        if (bret) {
+            event_process1(m_pc, onicecandidate, m_json);
+        }
+        return;
+    }
+
+    // The first candidate of a batch opens the window, and we are kept
+    // alive until the flush message is handled or cleared.
+    if (m_batch_count == 0) {
+        m_batch_format = format;
+        m_batch_records.clear();
+        m_batch_writer.Reset();
+        m_batch_writer.BeginArray();
+        m_batch_thread = talk_base::Thread::Current();
+        if (m_batch_thread) {
+            AddRef();
+            m_batch_thread->PostDelayed(window_ms, this, MSG_FLUSH_CANDIDATES);
+        }
+    }
+    bool bret = false;
+    if (m_batch_format == kBinarySignaling)
+        bret = AppendCompact(candidate, m_batch_records);
+    else
+        bret = Convert2Json(candidate, m_batch_writer);
+    if (bret) {
+        m_batch_count++;
+    }
+
+    if (!m_batch_thread || (max_count > 0 && m_batch_count >= max_count)) {
+        FlushCandidates();
+    }
+}
+
+void CRTCPeerConnectionObserver::FlushCandidates()
+{
+    if (m_batch_thread) {
+        talk_base::MessageList removed;
+        m_batch_thread->Clear(this, MSG_FLUSH_CANDIDATES, &removed);
+        m_batch_thread = NULL;
+        for (size_t k=0; k < removed.size(); k++) {
+            Release();
+        }
+    }
+
+    if (m_batch_count == 0)
+        return;
+    if (m_batch_format == kBinarySignaling)
+        EncodeCompactCandidates(m_batch_records, m_batch_count, m_batch);
+    else
+        m_batch_writer.EndArray();
+    m_batch_count = 0;
+    LOGD("flush candidates, bytes="<<m_batch.size());
+    event_process1(m_pc, onicecandidate, m_batch);
+}
+
+///
+/// for talk_base::MessageHandler
+void CRTCPeerConnectionObserver::OnMessage(talk_base::Message *msg)
+{
+    switch(msg->message_id) {
+    case MSG_FLUSH_CANDIDATES:
+        m_batch_thread = NULL;
+        FlushCandidates();
+        Release();
+        break;
     }
 }
 
@@ -109,6 +216,7 @@ void CRTCPeerConnectionObserver::OnIceCandidate(const webrtc::IceCandidateInterf
 // All Ice candidates have been found.
 void CRTCPeerConnectionObserver::OnIceComplete() {
     LOGD("from webrtc::PeerConnectionObserver");
+    FlushCandidates();
 }
 
 ///
@@ -117,8 +225,31 @@ void CRTCPeerConnectionObserver::OnSuccess(webrtc::SessionDescriptionInterface*
 {
     return_assert(description);
     
+    int format;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        format = m_format;
+
+        // The description is just created for us and not shared yet,
+        //  so it is safe to modify before serialization.
+        if (m_has_policy && description->description()) {
+            ApplySdpPolicy(m_policy, const_cast<cricket::SessionDescription *>(description->description()));
+        }
+    }
+
+    // Only the first local description takes the pooled transports, for later ones
+    //  keep the ice credentials and candidates of current one.
+    if (m_pc && m_pc->m_allocator_factory.get()) {
+        m_pc->m_allocator_factory->OnLocalDescription(description, !m_conn->local_description());
+    }
+
     std::string json;
-    if(Convert2Json(description, json)) {
+    bool bret = false;
+    if (format == kBinarySignaling)
+        bret = Convert2Compact(description, json);
+    else
+        bret = Convert2Json(description, json);
+    if (bret) {
         event_process1(m_pc, onsuccess, json);
     }
 }
@@ -2,6 +2,8 @@
 #define _OBSERVER_H_
 
 #include "webrtc.h"
+#include "json.h"
+#include "ubase/mutex.h"
 
 
 namespace xrtc {
@@ -12,16 +14,46 @@ class CRTCPeerConnection;
 //> for CRTCPeerConnectionObserver
 class CRTCPeerConnectionObserver :
     public webrtc::PeerConnectionObserver,
-    public webrtc::CreateSessionDescriptionObserver {
+    public webrtc::CreateSessionDescriptionObserver,
+    public talk_base::MessageHandler {
 private:
+    enum {
+        MSG_FLUSH_CANDIDATES,
+    };
+
     ubase::zeroptr<CRTCPeerConnection> m_pc;
     talk_base::scoped_refptr<webrtc::PeerConnectionInterface> m_conn;
+    std::string m_json;     // reused for candidates
+    int m_format;           // refer to signaling_format_t
+    sdp_policy_t m_policy;
+    bool m_has_policy;
+
+    // for candidate batching, on the signaling thread
+    int m_batch_window_ms;
+    int m_batch_max_count;
+    std::string m_batch;
+    CJsonWriter m_batch_writer;
+    std::string m_batch_records;    // for compact format
+    int m_batch_format;
+    int m_batch_count;
+    talk_base::Thread *m_batch_thread;
+    ubase::Mutex m_mutex;
 
 public:
     bool Init(ubase::zeroptr<CRTCPeerConnection> pc, talk_base::scoped_refptr<webrtc::PeerConnectionInterface> conn);
     explicit CRTCPeerConnectionObserver();
     virtual ~CRTCPeerConnectionObserver();
 
+    // Candidates within window_ms or up to max_count (0 for no limit) are sent in one json array,
+    //  and disabled if window_ms is 0.
+    void SetCandidateBatching(int window_ms, int max_count);
+
+    // @param format: refer to signaling_format_t
+    void SetSignalingFormat(int format);
+
+    // Applied to the created offer/answer before it is serialized.
+    void SetSdpPolicy(const sdp_policy_t &policy);
+
     ///
     /// for webrtc::PeerConnectionObserver
     virtual void OnError() ;
@@ -67,6 +99,12 @@ public:
     virtual void OnSuccess(webrtc::SessionDescriptionInterface* desc) ;
     virtual void OnFailure(const std::string& error) ;
 
+    ///
+    /// for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    void FlushCandidates();
 }; 
 
 }
@@ -0,0 +1,236 @@
+#include <algorithm>
+
+#include "overuse.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+// weight of the newest sample in the smoothed encode time
+static const double kSmoothingAlpha = 0.1;
+// samples needed after a change before deciding again
+static const int kMinSamples = 30;
+static const int kMaxUpHoldMs = 120 * 1000;
+
+static ubase::Mutex _detector_mutex;
+static COveruseDetector * _detector = NULL;
+
+static void GetDefaultLadder(std::vector<adaptation_step_t> &ladder)
+{
+    ladder.clear();
+    ladder.push_back(adaptation_step_t(100, 0));
+    ladder.push_back(adaptation_step_t(75, 0));
+    ladder.push_back(adaptation_step_t(50, 0));
+    ladder.push_back(adaptation_step_t(50, 15));
+    ladder.push_back(adaptation_step_t(50, 10));
+}
+
+COveruseDetector * COveruseDetector::Instance()
+{
+    ubase::ScopedLock lock(_detector_mutex);
+    if (!_detector) {
+        _detector = new COveruseDetector();
+#ifdef WEBRTC_H264
+        webrtc::H264Encoder::SetEncodeObserver(_detector);
+#endif
+    }
+    return _detector;
+}
+
+void COveruseDetector::Cleanup()
+{
+    ubase::ScopedLock lock(_detector_mutex);
+    if (_detector) {
+#ifdef WEBRTC_H264
+        // no callback in progress after it returns
+        webrtc::H264Encoder::SetEncodeObserver(NULL);
+#endif
+        delete _detector;
+        _detector = NULL;
+    }
+}
+
+COveruseDetector::COveruseDetector()
+{
+    GetDefaultLadder(m_config.ladder);
+    m_available = false;
+    m_level = 0;
+    m_width = 0;
+    m_height = 0;
+    m_encode_ms = 0;
+    m_samples = 0;
+    m_last_change = talk_base::Time();
+    m_up_hold_ms = m_config.up_hold_ms;
+    m_stepped_up = false;
+    m_started = m_thread.Start();
+}
+
+COveruseDetector::~COveruseDetector()
+{
+    if (m_started) {
+        m_thread.Stop();
+    }
+    m_tracks.clear();
+}
+
+void COveruseDetector::SetConfig(const adaptation_config_t &config)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_config = config;
+    if (m_config.ladder.empty()) {
+        GetDefaultLadder(m_config.ladder);
+    }
+    m_up_hold_ms = m_config.up_hold_ms;
+    m_stepped_up = false;
+
+    int level = m_level;
+    if (!m_config.enabled)
+        level = 0;
+    else if (level >= (int)m_config.ladder.size())
+        level = (int)m_config.ladder.size() - 1;
+    if (level != m_level) {
+        SetLevel(level);
+    }
+}
+
+void COveruseDetector::GetState(adaptation_state_t &state)
+{
+    ubase::ScopedLock lock(m_mutex);
+    state.available = m_available;
+    state.level = m_level;
+    state.levels = (int)m_config.ladder.size();
+    state.width = m_width;
+    state.height = m_height;
+    state.frameRate = m_config.ladder[m_level].frameRate;
+    state.encode_ms = (int)m_encode_ms;
+}
+
+void COveruseDetector::AddTrack(MediaStreamTrackPtr track)
+{
+    return_assert(track.get());
+
+    ubase::ScopedLock alock(m_apply_mutex);
+    adaptation_step_t step;
+    int level;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        for (size_t k=0; k < m_tracks.size(); k++) {
+            if (m_tracks[k].get() == track.get())
+                return;
+        }
+        m_tracks.push_back(track);
+        level = m_level;
+        step = m_config.ladder[m_level];
+    }
+
+    // join the current step at once
+    if (level > 0) {
+        ApplyStep(track, &step);
+    }
+}
+
+void COveruseDetector::RemoveTrack(MediaStreamTrackPtr track)
+{
+    return_assert(track.get());
+
+    ubase::ScopedLock alock(m_apply_mutex);
+    bool found = false;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        std::vector<MediaStreamTrackPtr>::iterator iter;
+        for (iter = m_tracks.begin(); iter != m_tracks.end(); iter++) {
+            if ((*iter).get() == track.get()) {
+                m_tracks.erase(iter);
+                found = true;
+                break;
+            }
+        }
+    }
+
+    if (found) {
+        ApplyStep(track, NULL);
+    }
+}
+
+void COveruseDetector::OnFrameEncoded(int width, int height, int64_t capture_time_ms, int encode_time_ms)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_available = true;
+    m_width = width;
+    m_height = height;
+    if (!m_config.enabled || m_tracks.empty())
+        return;
+
+    if (m_samples == 0)
+        m_encode_ms = encode_time_ms;
+    else
+        m_encode_ms = kSmoothingAlpha * encode_time_ms + (1 - kSmoothingAlpha) * m_encode_ms;
+    m_samples++;
+    if (m_samples < kMinSamples)
+        return;
+
+    int levels = (int)m_config.ladder.size();
+    int elapsed = talk_base::TimeSince(m_last_change);
+    if (m_encode_ms > m_config.overuse_ms && m_level + 1 < levels && elapsed >= m_config.down_hold_ms) {
+        // hysteresis: the last step up was too optimistic, so wait longer next time
+        if (m_stepped_up && elapsed < m_up_hold_ms) {
+            m_up_hold_ms = std::min(m_up_hold_ms * 2, kMaxUpHoldMs);
+        }else {
+            m_up_hold_ms = m_config.up_hold_ms;
+        }
+        m_stepped_up = false;
+        LOGI("cpu overuse, encode_ms="<<m_encode_ms<<", level="<<m_level + 1);
+        SetLevel(m_level + 1);
+    }else if (m_encode_ms < m_config.underuse_ms && m_level > 0 && elapsed >= m_up_hold_ms) {
+        m_stepped_up = true;
+        LOGI("cpu underuse, encode_ms="<<m_encode_ms<<", level="<<m_level - 1);
+        SetLevel(m_level - 1);
+    }
+}
+
+// with m_mutex held
+void COveruseDetector::SetLevel(int level)
+{
+    m_level = level;
+    m_last_change = talk_base::Time();
+    m_samples = 0;
+    if (m_started) {
+        m_thread.Post(this, MSG_ADAPT);
+    }
+}
+
+// The step scales the output of each track by its own constraints, so the full
+// size is per track, and the app's applyConstraints is kept under the cap.
+void COveruseDetector::ApplyStep(MediaStreamTrackPtr track, const adaptation_step_t *step)
+{
+    if (!step) {
+        SetTrackAdaptation(track, 100, 0);
+    }else {
+        SetTrackAdaptation(track, step->scale, step->frameRate);
+    }
+}
+
+void COveruseDetector::OnMessage(talk_base::Message *msg)
+{
+    switch(msg->message_id) {
+    case MSG_ADAPT: {
+        ubase::ScopedLock alock(m_apply_mutex);
+        std::vector<MediaStreamTrackPtr> tracks;
+        adaptation_step_t step;
+        int level;
+        {
+            ubase::ScopedLock lock(m_mutex);
+            tracks = m_tracks;
+            level = m_level;
+            step = m_config.ladder[m_level];
+        }
+
+        LOGI("adapt to level="<<level<<", scale="<<step.scale<<", frameRate="<<step.frameRate);
+        for (size_t k=0; k < tracks.size(); k++) {
+            ApplyStep(tracks[k], (level > 0) ? &step : NULL);
+        }
+        break;
+    }
+    }
+}
+
+} // namespace xrtc
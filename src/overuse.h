@@ -0,0 +1,71 @@
+#ifndef _OVERUSE_H_
+#define _OVERUSE_H_
+
+#include "webrtc.h"
+#include "ubase/mutex.h"
+
+#ifdef WEBRTC_H264
+#include "webrtc/modules/video_coding/codecs/h264/include/h264.h"
+#endif
+
+namespace xrtc {
+
+//
+//> for COveruseDetector
+// Process-wide detector of cpu overuse by the capture-to-encode time of each
+// frame (reported by the h264 encoder), which steps local video tracks down
+// and up along a ladder of resolution and frame rate.
+class COveruseDetector : public talk_base::MessageHandler
+#ifdef WEBRTC_H264
+    , public webrtc::H264EncodeObserver
+#endif
+{
+public:
+    static COveruseDetector * Instance();
+    static void Cleanup();
+
+    void SetConfig(const adaptation_config_t &config);
+    void GetState(adaptation_state_t &state);
+
+    // tracks are capped on top of their own constraints, and restored when removed
+    void AddTrack(MediaStreamTrackPtr track);
+    void RemoveTrack(MediaStreamTrackPtr track);
+
+    // called from the encoding thread
+    virtual void OnFrameEncoded(int width, int height, int64_t capture_time_ms, int encode_time_ms);
+
+    // for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    enum {
+        MSG_ADAPT,
+    };
+
+    explicit COveruseDetector();
+    virtual ~COveruseDetector();
+
+    void SetLevel(int level);
+    static void ApplyStep(MediaStreamTrackPtr track, const adaptation_step_t *step);
+
+    talk_base::Thread m_thread;
+    bool m_started;
+    adaptation_config_t m_config;
+    std::vector<MediaStreamTrackPtr> m_tracks;
+
+    bool m_available;
+    int m_level;
+    int m_width;
+    int m_height;
+    double m_encode_ms;
+    int m_samples;
+    uint32 m_last_change;
+    int m_up_hold_ms;
+    bool m_stepped_up;
+    ubase::Mutex m_mutex;
+    ubase::Mutex m_apply_mutex;     // serialize applying steps to tracks
+};
+
+} // namespace xrtc
+
+#endif // _OVERUSE_H_
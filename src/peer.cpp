@@ -23,23 +23,55 @@
  */
 
 #include "peer.h"
+#include "compact.h"
 #include "ubase/error.h"
 
+#include "talk/base/timeutils.h"
+#include "talk/p2p/base/constants.h"
+#include "talk/session/media/mediasession.h"
+
 namespace xrtc {
 
-class DummySetSessionDescriptionObserver : public webrtc::SetSessionDescriptionObserver {
+//
+// Reports the completion of set{Local,Remote}Description with the elapsed time
+//  from the call, including the parsing of sdp.
+class CSetDescriptionObserver : public webrtc::SetSessionDescriptionObserver {
 public:
-    static DummySetSessionDescriptionObserver* Create() {
-        return new talk_base::RefCountedObject<DummySetSessionDescriptionObserver>();
+    static CSetDescriptionObserver* Create(ubase::zeroptr<CRTCPeerConnection> pc, bool local, uint64 start_ns) {
+        return new talk_base::RefCountedObject<CSetDescriptionObserver>(pc, local, start_ns);
+    }
+    static void Complete(ubase::zeroptr<CRTCPeerConnection> pc, bool local, uint64 start_ns, const std::string &error) {
+        long elapsed_us = (long)((talk_base::TimeNanos() - start_ns) / talk_base::kNumNanosecsPerMicrosec);
+        if (!error.empty()) {
+            LOGW("fail to set "<<(local ? "local" : "remote")<<" description, error="<<error);
+        }
+        // the json read before the description is set could be of the old one
+        pc->ClearCachedJson(local ? pc->m_local_cache : pc->m_remote_cache);
+        if (local) {
+            event_process2(pc, onsetlocaldescription, error, elapsed_us);
+        }else {
+            event_process2(pc, onsetremotedescription, error, elapsed_us);
+        }
     }
+
     virtual void OnSuccess() {
+        Complete(m_pc, m_local, m_start_ns, "");
+        m_pc = NULL;
     }
     virtual void OnFailure(const std::string& error) {
+        Complete(m_pc, m_local, m_start_ns, error.empty() ? "unknown error" : error);
+        m_pc = NULL;
     }
 
 protected:
-    DummySetSessionDescriptionObserver() {}
-    ~DummySetSessionDescriptionObserver() {}
+    CSetDescriptionObserver(ubase::zeroptr<CRTCPeerConnection> pc, bool local, uint64 start_ns) 
+        : m_pc(pc), m_local(local), m_start_ns(start_ns) {}
+    ~CSetDescriptionObserver() {}
+
+private:
+    ubase::zeroptr<CRTCPeerConnection> m_pc;
+    bool m_local;
+    uint64 m_start_ns;
 };
 
 
@@ -47,13 +79,27 @@ protected:
 //> for CRTCPeerConnection
 bool CRTCPeerConnection::Init(
     webrtc::PeerConnectionInterface::IceServers servers,
+    const rtc_config_t &config,
     talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory)
 {
     returnb_assert (pc_factory.get() != NULL);
 
     m_observer = new talk_base::RefCountedObject<CRTCPeerConnectionObserver>();
 
-    m_conn = pc_factory->CreatePeerConnection(servers, NULL, NULL, NULL, (webrtc::PeerConnectionObserver *)m_observer);
+    // no stun/turn server to resolve and allocate on for host candidates
+    if (config.ice_transport_policy == kIceTransportHost) {
+        servers.clear();
+    }
+
+    // The default allocator of factory is used unless pooling or policies of candidates.
+    m_config = config;
+    if (CPortAllocatorFactory::IsNeeded(config)) {
+        // the factories are all created on the worker thread of xrtc
+        m_allocator_factory = CPortAllocatorFactory::Create(GetWorkerThread(), config);
+        returnb_assert(m_allocator_factory.get() != NULL);
+    }
+
+    m_conn = pc_factory->CreatePeerConnection(servers, NULL, m_allocator_factory.get(), NULL, (webrtc::PeerConnectionObserver *)m_observer);
     returnb_assert(m_conn.get() != NULL);
     return m_observer->Init(this, m_conn);
 }
@@ -62,12 +108,14 @@ CRTCPeerConnection::CRTCPeerConnection ()
 {
     m_conn = NULL;
     m_observer = NULL; 
+    m_allocator_factory = NULL;
 }
 
 CRTCPeerConnection::~CRTCPeerConnection ()
 {
     m_conn = NULL;
     m_observer = NULL;
+    m_allocator_factory = NULL;
 }
 
 void * CRTCPeerConnection::getptr() 
@@ -75,20 +123,56 @@ void * CRTCPeerConnection::getptr()
     return m_conn.get();
 }
 
+static void GetCandidateCounts(const webrtc::SessionDescriptionInterface *description, std::vector<size_t> &counts)
+{
+    counts.clear();
+    for (size_t k=0; k < description->number_of_mediasections(); k++) {
+        const webrtc::IceCandidateCollection *candidates = description->candidates(k);
+        counts.push_back(candidates ? candidates->count() : 0);
+    }
+}
+
+// The json is serialized once for each description object and its candidates, which
+//  are gathered into the local one and added into the remote one in place. The cache
+//  is dropped when a new description is set, for the old object may be freed and its
+//  address reused.
+DOMString CRTCPeerConnection::GetCachedJson(const webrtc::SessionDescriptionInterface *description, description_cache_t &cache)
+{
+    ubase::ScopedLock lock(m_cache_mutex);
+    if (!description) {
+        return DOMString();
+    }
+    std::vector<size_t> candidates;
+    GetCandidateCounts(description, candidates);
+    if (cache.description != description || cache.candidates != candidates) {
+        cache.json.clear();
+        cache.description = NULL;
+        if (Convert2Json(description, cache.json)) {
+            cache.description = description;
+            cache.candidates.swap(candidates);
+        }
+    }
+    return cache.json;
+}
+
+void CRTCPeerConnection::ClearCachedJson(description_cache_t &cache)
+{
+    ubase::ScopedLock lock(m_cache_mutex);
+    cache.description = NULL;
+    cache.candidates.clear();
+    cache.json.clear();
+}
+
 DOMString CRTCPeerConnection::localDescription()
 {
-    DOMString json;
-    returnv_assert(m_conn.get(), json);
-    Convert2Json(m_conn->local_description(), json);
-    return json;
+    returnv_assert(m_conn.get(), DOMString());
+    return GetCachedJson(m_conn->local_description(), m_local_cache);
 }
 
 DOMString CRTCPeerConnection::remoteDescription()
 {
-    DOMString json;
-    returnv_assert(m_conn.get(), json);
-    Convert2Json(m_conn->remote_description(), json);
-    return json;
+    returnv_assert(m_conn.get(), DOMString());
+    return GetCachedJson(m_conn->remote_description(), m_remote_cache);
 }
 
 RTCSignalingState CRTCPeerConnection::signalingState() 
@@ -115,56 +199,224 @@ RTCIceConnectionState CRTCPeerConnection::iceConnectionState()
     return state;
 }
 
+static void ConvertIceServers(const RTCConfiguration & configuration, webrtc::PeerConnectionInterface::IceServers &servers)
+{
+    for (size_t k=0; k < configuration.iceServers.size(); k++) {
+        const RTCIceServer &ice_server = configuration.iceServers[k];
+        for (size_t i=0; i < ice_server.urls.size(); i++) {
+            webrtc::PeerConnectionInterface::IceServer server;
+            server.uri = ice_server.urls[i];
+            server.username = ice_server.username;
+            server.password = ice_server.credential;
+            servers.push_back(server);
+        }
+    }
+}
+
+// The policies of bundle and rtcp-mux apply to the next offer/answer and remote description,
+//  and those of candidates to gathering afterwards.
 void CRTCPeerConnection::setParams (const RTCConfiguration & configuration, const MediaConstraints & constraints)
-{}
+{
+    return_assert(m_conn.get());
+
+    if (!configuration.iceServers.empty()) {
+        webrtc::PeerConnectionInterface::IceServers servers;
+        ConvertIceServers(configuration, servers);
+        if (!m_conn->UpdateIce(servers, NULL)) {
+            LOGW("fail to update ice servers, keep the current");
+        }
+    }
+
+    m_config.bundle_policy = configuration.bundlePolicy;
+    m_config.rtcp_mux_policy = configuration.rtcpMuxPolicy;
+    m_config.ice_transport_policy = configuration.iceTransportPolicy;
+    m_config.network_ignore = configuration.networkIgnore;
+    m_config.network_allowlist = configuration.networkAllowlist;
+    m_config.ip_policy = configuration.ipPolicy;
+    if (m_allocator_factory.get()) {
+        m_allocator_factory->SetConfig(m_config);
+    }else if (CPortAllocatorFactory::IsNeeded(m_config)) {
+        LOGW("policies of candidates need to be set when peer connection created");
+    }
+}
+
+void CRTCPeerConnection::GetOfferConstraints(WebrtcMediaConstraints &constraints)
+{
+    if (m_config.bundle_policy == kBundlePolicyMaxCompat) {
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kUseRtpMux, false);
+    }else if (m_config.bundle_policy == kBundlePolicyMaxBundle) {
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kUseRtpMux, true);
+    }
+}
+
+// The remote description should agree with the required bundle and rtcp-mux.
+bool CRTCPeerConnection::CheckRemotePolicy(const webrtc::SessionDescriptionInterface *description, std::string &error)
+{
+    const cricket::SessionDescription *sdesc = description->description();
+    returnb_assert(sdesc);
+
+    int contents = 0;
+    for (size_t k=0; k < sdesc->contents().size(); k++) {
+        const cricket::ContentInfo &content = sdesc->contents()[k];
+        if (content.rejected || !cricket::IsMediaContent(&content))
+            continue;
+        contents++;
+
+        const cricket::MediaContentDescription *media = static_cast<const cricket::MediaContentDescription *>(content.description);
+        if (m_config.rtcp_mux_policy == kRtcpMuxPolicyRequire && !media->rtcp_mux()) {
+            error = "rtcp-mux is required for " + content.name;
+            return false;
+        }
+    }
+
+    if (m_config.bundle_policy == kBundlePolicyMaxBundle && contents > 1 && 
+        !sdesc->HasGroup(cricket::GROUP_TYPE_BUNDLE)) {
+        error = "bundle is required";
+        return false;
+    }
+    return true;
+}
 
 void CRTCPeerConnection::createOffer (const MediaConstraints & constraints)
 {
     return_assert(m_conn.get());
     return_assert(m_observer.get());
-    m_conn->CreateOffer((webrtc::CreateSessionDescriptionObserver *)m_observer, NULL);
+
+    WebrtcMediaConstraints offer_constraints;
+    GetOfferConstraints(offer_constraints);
+    m_conn->CreateOffer((webrtc::CreateSessionDescriptionObserver *)m_observer, &offer_constraints);
 }
 
 void CRTCPeerConnection::createAnswer (const MediaConstraints & constraints)
 {
     return_assert(m_conn.get());
     return_assert(m_observer.get());
-    m_conn->CreateAnswer((webrtc::CreateSessionDescriptionObserver *)m_observer, NULL);
+
+    WebrtcMediaConstraints answer_constraints;
+    GetOfferConstraints(answer_constraints);
+    m_conn->CreateAnswer((webrtc::CreateSessionDescriptionObserver *)m_observer, &answer_constraints);
 }
 
 void CRTCPeerConnection::setLocalDescription (const DOMString & json)
 {
     return_assert(m_conn.get());
     
+    uint64 start_ns = talk_base::TimeNanos();
     webrtc::SessionDescriptionInterface* description = NULL;
-    if (Convert2SDP(json, description) && description) {
-        m_conn->SetLocalDescription(DummySetSessionDescriptionObserver::Create(), description);
+    if (!Convert2SDP(json, description) || !description) {
+        CSetDescriptionObserver::Complete(this, true, start_ns, "invalid session description");
+        return;
     }
+    ClearCachedJson(m_local_cache);
+    m_conn->SetLocalDescription(CSetDescriptionObserver::Create(this, true, start_ns), description);
 }
 
 void CRTCPeerConnection::setRemoteDescription (const DOMString & json)
 {
     return_assert(m_conn.get());
     
+    uint64 start_ns = talk_base::TimeNanos();
     webrtc::SessionDescriptionInterface* description = NULL;
-    if (Convert2SDP(json, description) && description) {
-        m_conn->SetRemoteDescription(DummySetSessionDescriptionObserver::Create(), description);
+    if (!Convert2SDP(json, description) || !description) {
+        CSetDescriptionObserver::Complete(this, false, start_ns, "invalid session description");
+        return;
     }
+
+    std::string error;
+    if (!CheckRemotePolicy(description, error)) {
+        delete description;
+        CSetDescriptionObserver::Complete(this, false, start_ns, error);
+        return;
+    }
+    ClearCachedJson(m_remote_cache);
+    m_conn->SetRemoteDescription(CSetDescriptionObserver::Create(this, false, start_ns), description);
 }
 
+// An offer with new ice credentials on current connection, which restarts ice when
+//  applied, with media channels kept alive. The ice servers are updated if given.
 void CRTCPeerConnection::updateIce (const RTCConfiguration & configuration, const MediaConstraints & constraints)
 {
+    return_assert(m_conn.get());
+    return_assert(m_observer.get());
+
+    if (!configuration.iceServers.empty()) {
+        webrtc::PeerConnectionInterface::IceServers servers;
+        ConvertIceServers(configuration, servers);
+        if (!m_conn->UpdateIce(servers, NULL)) {
+            LOGW("fail to update ice servers, keep the current");
+        }
+    }
+
+    WebrtcMediaConstraints offer_constraints;
+    GetOfferConstraints(offer_constraints);
+    offer_constraints.AddMandatory(webrtc::MediaConstraintsInterface::kIceRestart, true);
+    m_conn->CreateOffer((webrtc::CreateSessionDescriptionObserver *)m_observer, &offer_constraints);
 }
 
+// The json is one candidate object, or an array of them when batched,
+//  or the compact form of either.
 void CRTCPeerConnection::addIceCandidate (const DOMString & json)
 {
     return_assert(m_conn.get());
+
+    if (IsCompactSignaling(json.data(), json.size())) {
+        std::vector<compact_candidate_t> items;
+        if (!DecodeCompactCandidates(json.data(), json.size(), items)) {
+            LOGW("invalid compact candidates, size="<<json.size());
+            return;
+        }
+        for (size_t k=0; k < items.size(); k++) {
+            webrtc::IceCandidateInterface * candidate = webrtc::CreateIceCandidate(items[k].mid, items[k].mline, items[k].sdp);
+            if (candidate) {
+                talk_base::scoped_ptr<webrtc::IceCandidateInterface> holder(candidate);
+                m_conn->AddIceCandidate(candidate);
+            }
+        }
+        return;
+    }
+
+    size_t pos = json.find_first_not_of(" \t\r\n");
+    if (pos != DOMString::npos && json[pos] == '[') {
+        std::vector<json_view_t> items;
+        if (!CJsonReader::SplitArray(json.data(), json.size(), items)) {
+            LOGW("invalid candidates: "<<json);
+            return;
+        }
+        for (size_t k=0; k < items.size(); k++) {
+            webrtc::IceCandidateInterface * candidate = NULL;
+            if (Convert2ICE(items[k].data, items[k].len, candidate) && candidate) {
+                talk_base::scoped_ptr<webrtc::IceCandidateInterface> holder(candidate);
+                m_conn->AddIceCandidate(candidate);
+            }
+        }
+        return;
+    }
+
     webrtc::IceCandidateInterface * candidate = NULL;
     if (Convert2ICE(json, candidate) && candidate) {
+        talk_base::scoped_ptr<webrtc::IceCandidateInterface> holder(candidate);
         m_conn->AddIceCandidate(candidate);
     }
 }
 
+void CRTCPeerConnection::setCandidateBatching (int window_ms, int max_count)
+{
+    return_assert(m_observer.get());
+    m_observer->SetCandidateBatching(window_ms, max_count);
+}
+
+void CRTCPeerConnection::setSignalingFormat (int format)
+{
+    return_assert(m_observer.get());
+    m_observer->SetSignalingFormat(format);
+}
+
+void CRTCPeerConnection::setSdpPolicy (const sdp_policy_t & policy)
+{
+    return_assert(m_observer.get());
+    m_observer->SetSdpPolicy(policy);
+}
+
 sequence<MediaStreamPtr> CRTCPeerConnection::getLocalStreams ()
 {
     sequence<MediaStreamPtr> streams;
@@ -244,6 +496,8 @@ void CRTCPeerConnection::close ()
 {
     return_assert(m_conn.get());
     m_conn->Close();
+    ClearCachedJson(m_local_cache);
+    ClearCachedJson(m_remote_cache);
 }
 
 
@@ -251,9 +505,10 @@ void CRTCPeerConnection::close ()
 //> for create interface
 ubase::zeroptr<RTCPeerConnection> CreatePeerConnection(
     webrtc::PeerConnectionInterface::IceServers servers,
+    const rtc_config_t &config,
     talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory) {
     ubase::zeroptr<CRTCPeerConnection> pc = new ubase::RefCounted<CRTCPeerConnection>();
-    if (!pc.get() || !pc->Init(servers, pc_factory)) {
+    if (!pc.get() || !pc->Init(servers, config, pc_factory)) {
         pc = NULL;
     }
     return pc;
@@ -25,6 +25,9 @@
 #include "xrtc_std.h"
 #include "webrtc.h"
 #include "observer.h"
+#include "allocator.h"
+#include "constraints.h"
+#include "ubase/mutex.h"
 
 namespace xrtc {
 
@@ -32,14 +35,36 @@ namespace xrtc {
 //> for CRTCPeerConnection
 class CRTCPeerConnection : public RTCPeerConnection {
     friend class CRTCPeerConnectionObserver;
+    friend class CSetDescriptionObserver;
 
 private:
     talk_base::scoped_refptr<CRTCPeerConnectionObserver> m_observer;
     talk_base::scoped_refptr<webrtc::PeerConnectionInterface> m_conn;
+    talk_base::scoped_refptr<CPortAllocatorFactory> m_allocator_factory;    // NULL for the default
+    rtc_config_t m_config;
+
+    // The serialized json of local/remote description, cached by the description object
+    //  and its candidates, which webrtc adds in place.
+    struct description_cache_t {
+        const webrtc::SessionDescriptionInterface *description;
+        std::vector<size_t> candidates;     // count per media section
+        DOMString json;
+        description_cache_t() : description(NULL) {}
+    };
+    description_cache_t m_local_cache;
+    description_cache_t m_remote_cache;
+    ubase::Mutex m_cache_mutex;
+
+    DOMString GetCachedJson(const webrtc::SessionDescriptionInterface *description, description_cache_t &cache);
+    void ClearCachedJson(description_cache_t &cache);
+
+    void GetOfferConstraints(WebrtcMediaConstraints &constraints);
+    bool CheckRemotePolicy(const webrtc::SessionDescriptionInterface *description, std::string &error);
 
 public:
     bool Init(
         webrtc::PeerConnectionInterface::IceServers servers,
+        const rtc_config_t &config,
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory);
 
     explicit CRTCPeerConnection ();
@@ -59,6 +84,9 @@ public:
     virtual void setRemoteDescription (const DOMString & description);
     virtual void updateIce (const RTCConfiguration & configuration, const MediaConstraints & constraints);
     virtual void addIceCandidate (const DOMString & candidate);
+    virtual void setCandidateBatching (int window_ms, int max_count);
+    virtual void setSignalingFormat (int format);
+    virtual void setSdpPolicy (const sdp_policy_t & policy);
 
     virtual sequence<MediaStreamPtr> getLocalStreams ();
     virtual sequence<MediaStreamPtr> getRemoteStreams ();
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+
+#include "webrtc.h"
+#include "ubase/error.h"
+
+#include "talk/base/stringutils.h"
+#include "talk/media/base/constants.h"
+#include "talk/session/media/mediasession.h"
+
+namespace xrtc {
+
+static const char kH264CodecName[] = "H264";
+static const char kProfileLevelId[] = "profile-level-id";
+
+static bool IsNamed(const std::string &name, const char *other)
+{
+    return talk_base::_stricmp(name.c_str(), other) == 0;
+}
+
+// red/ulpfec are not primary codecs and kept with the listed ones.
+static bool IsRedundancy(const std::string &name)
+{
+    return IsNamed(name, cricket::kRedCodecName) || IsNamed(name, cricket::kUlpfecCodecName);
+}
+
+//
+// Reorder codecs by the listed names, and the unlisted follow in their own order
+//  or are removed when stripped.
+template <class C>
+static void OrderCodecs(const std::vector<std::string> &names, bool strip, std::vector<C> &codecs)
+{
+    if (names.empty())
+        return;
+
+    std::vector<C> ordered;
+    std::vector<bool> taken(codecs.size(), false);
+    ordered.reserve(codecs.size());
+    for (size_t k=0; k < names.size(); k++) {
+        for (size_t i=0; i < codecs.size(); i++) {
+            if (!taken[i] && IsNamed(codecs[i].name, names[k].c_str())) {
+                ordered.push_back(codecs[i]);
+                taken[i] = true;
+            }
+        }
+    }
+
+    for (size_t i=0; i < codecs.size(); i++) {
+        if (taken[i])
+            continue;
+        if (strip && !IsRedundancy(codecs[i].name)) {
+            if (!IsNamed(codecs[i].name, cricket::kRtxCodecName))
+                continue;
+
+            // rtx is kept only for the payload type it is associated with
+            std::string apt;
+            bool found = false;
+            if (codecs[i].GetParam(cricket::kCodecParamAssociatedPayloadType, &apt)) {
+                int id = atoi(apt.c_str());
+                for (size_t j=0; j < ordered.size() && !found; j++) {
+                    found = (ordered[j].id == id);
+                }
+            }
+            if (!found)
+                continue;
+        }
+        ordered.push_back(codecs[i]);
+    }
+
+    if (ordered.empty()) {
+        LOGW("no codec left by policy, keep all");
+        return;
+    }
+    codecs.swap(ordered);
+}
+
+static void SetRtcpFeedback(int flags, cricket::VideoCodec &codec)
+{
+    cricket::FeedbackParams params;
+    if (flags & kRtcpFbNack)
+        params.Add(cricket::FeedbackParam(cricket::kRtcpFbParamNack, cricket::kParamValueEmpty));
+    if (flags & kRtcpFbNackPli)
+        params.Add(cricket::FeedbackParam(cricket::kRtcpFbParamNack, cricket::kRtcpFbNackParamPli));
+    if (flags & kRtcpFbCcmFir)
+        params.Add(cricket::FeedbackParam(cricket::kRtcpFbParamCcm, cricket::kRtcpFbCcmParamFir));
+    if (flags & kRtcpFbRemb)
+        params.Add(cricket::FeedbackParam(cricket::kRtcpFbParamRemb, cricket::kParamValueEmpty));
+    codec.feedback_params = params;
+}
+
+static void ApplyAudioPolicy(const sdp_policy_t &policy, cricket::AudioContentDescription *audio)
+{
+    std::vector<cricket::AudioCodec> codecs = audio->codecs();
+    OrderCodecs(policy.audio_codecs, policy.strip_unlisted, codecs);
+    audio->set_codecs(codecs);
+
+    // b=AS is written in kbps from the bandwidth in bps.
+    if (policy.audio_bandwidth > 0)
+        audio->set_bandwidth(policy.audio_bandwidth * 1000);
+}
+
+static void ApplyVideoPolicy(const sdp_policy_t &policy, cricket::VideoContentDescription *video)
+{
+    std::vector<cricket::VideoCodec> codecs = video->codecs();
+    OrderCodecs(policy.video_codecs, policy.strip_unlisted, codecs);
+
+    for (size_t k=0; k < codecs.size(); k++) {
+        cricket::VideoCodec &codec = codecs[k];
+        if (!policy.h264_profile_level_id.empty() && IsNamed(codec.name, kH264CodecName)) {
+            codec.SetParam(kProfileLevelId, policy.h264_profile_level_id);
+        }
+        if (policy.video_rtcp_fb >= 0 && !IsRedundancy(codec.name) && !IsNamed(codec.name, cricket::kRtxCodecName)) {
+            SetRtcpFeedback(policy.video_rtcp_fb, codec);
+        }
+    }
+    video->set_codecs(codecs);
+
+    if (policy.video_bandwidth > 0)
+        video->set_bandwidth(policy.video_bandwidth * 1000);
+}
+
+void ApplySdpPolicy(const sdp_policy_t &policy, cricket::SessionDescription *sdesc)
+{
+    return_assert(sdesc);
+
+    const cricket::ContentInfos &contents = sdesc->contents();
+    for (size_t k=0; k < contents.size(); k++) {
+        const cricket::ContentInfo &content = contents[k];
+        if (content.rejected)
+            continue;
+
+        cricket::ContentDescription *desc = sdesc->GetContentDescriptionByName(content.name);
+        if (!desc)
+            continue;
+        if (cricket::IsAudioContent(&content)) {
+            ApplyAudioPolicy(policy, static_cast<cricket::AudioContentDescription *>(desc));
+        }else if (cricket::IsVideoContent(&content)) {
+            ApplyVideoPolicy(policy, static_cast<cricket::VideoContentDescription *>(desc));
+        }
+    }
+}
+
+} // namespace xrtc
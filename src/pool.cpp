@@ -0,0 +1,156 @@
+#include "pool.h"
+#include "ubase/error.h"
+
+namespace xrtc {
+
+CPeerConnectionPool::CPeerConnectionPool()
+{
+    m_size = 0;
+    m_generation = 0;
+    m_started = m_thread.Start();
+}
+
+CPeerConnectionPool::~CPeerConnectionPool()
+{
+    if (m_started) {
+        m_thread.Clear(this);
+        m_thread.Stop();
+    }
+    Clear();
+    m_pc_factory = NULL;
+}
+
+void CPeerConnectionPool::SetConfig(int size, const ice_servers_t &servers, const rtc_config_t &config)
+{
+    bool changed = false;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        size = (size > 0) ? size : 0;
+        changed = (size != m_size) || !IsSameServers(servers, m_servers) || !IsSameConfig(config, m_config);
+        if (changed) {
+            m_size = size;
+            m_servers = servers;
+            m_config = config;
+            m_generation++;
+        }
+    }
+
+    if (changed) {
+        Clear();
+        if (size > 0 && m_started) {
+            m_thread.Post(this, MSG_REFILL);
+        }
+    }
+}
+
+bool CPeerConnectionPool::Take(const ice_servers_t &servers,
+        const rtc_config_t &config,
+        talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &pc_factory,
+        ubase::zeroptr<RTCPeerConnection> &pc)
+{
+    ubase::ScopedLock lock(m_mutex);
+    if (m_pcs.empty() || !IsSameServers(servers, m_servers) || !IsSameConfig(config, m_config)) {
+        return false;
+    }
+
+    pc_factory = m_pcs.front().pc_factory;
+    pc = m_pcs.front().pc;
+    m_pcs.pop_front();
+    if (m_started) {
+        m_thread.Post(this, MSG_REFILL);
+    }
+    return true;
+}
+
+void CPeerConnectionPool::OnMessage(talk_base::Message *msg)
+{
+    if (msg->message_id != MSG_REFILL)
+        return;
+
+    for (;;) {
+        int generation;
+        ice_servers_t servers;
+        rtc_config_t config;
+        {
+            ubase::ScopedLock lock(m_mutex);
+            if ((int)m_pcs.size() >= m_size)
+                break;
+            generation = m_generation;
+            servers = m_servers;
+            config = m_config;
+        }
+
+        // The factory starts its own threads and media engine, which is the most
+        //  part of the time to create a peer connection, so only once for all.
+        if (!m_pc_factory.get()) {
+            m_pc_factory = CreatePeerConnectionFactory();
+            if (!m_pc_factory.get()) {
+                LOGW("fail to create peer connection factory for pool");
+                break;
+            }
+        }
+
+        pooled_pc_t item;
+        item.pc_factory = m_pc_factory;
+
+        webrtc::PeerConnectionInterface::IceServers ice_servers;
+        Convert2IceServers(servers, ice_servers);
+        item.pc = CreatePeerConnection(ice_servers, config, item.pc_factory);
+        if (!item.pc.get()) {
+            LOGW("fail to create peer connection for pool");
+            break;
+        }
+
+        {
+            ubase::ScopedLock lock(m_mutex);
+            if (generation == m_generation && (int)m_pcs.size() < m_size) {
+                m_pcs.push_back(item);
+                LOGD("pooled peer connections: "<<m_pcs.size());
+                continue;
+            }
+        }
+
+        // the config is changed during creation
+        item.pc->close();
+    }
+}
+
+bool CPeerConnectionPool::IsSameServers(const ice_servers_t &servers1, const ice_servers_t &servers2)
+{
+    if (servers1.size() != servers2.size())
+        return false;
+    for (size_t k=0; k < servers1.size(); k++) {
+        if (servers1[k].uri != servers2[k].uri ||
+            servers1[k].username != servers2[k].username ||
+            servers1[k].password != servers2[k].password) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CPeerConnectionPool::IsSameConfig(const rtc_config_t &config1, const rtc_config_t &config2)
+{
+    return (config1.ice_candidate_pool_size == config2.ice_candidate_pool_size &&
+            config1.bundle_policy == config2.bundle_policy &&
+            config1.rtcp_mux_policy == config2.rtcp_mux_policy &&
+            config1.ice_transport_policy == config2.ice_transport_policy &&
+            config1.network_ignore == config2.network_ignore &&
+            config1.network_allowlist == config2.network_allowlist &&
+            config1.ip_policy == config2.ip_policy);
+}
+
+void CPeerConnectionPool::Clear()
+{
+    std::deque<pooled_pc_t> pcs;
+    {
+        ubase::ScopedLock lock(m_mutex);
+        pcs.swap(m_pcs);
+    }
+
+    for (size_t k=0; k < pcs.size(); k++) {
+        pcs[k].pc->close();
+    }
+}
+
+} // namespace xrtc
@@ -0,0 +1,59 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <deque>
+
+#include "webrtc.h"
+#include "ubase/mutex.h"
+
+namespace xrtc {
+
+//
+//> for CPeerConnectionPool
+// Peer connections created ahead of the call on a background thread, which are
+// taken in O(1) and refilled in background. They share one factory of the pool.
+class CPeerConnectionPool : public talk_base::MessageHandler {
+public:
+    explicit CPeerConnectionPool();
+    virtual ~CPeerConnectionPool();
+
+    // The pooled connections are dropped if size, servers or config change, and size 0 disables the pool.
+    void SetConfig(int size, const ice_servers_t &servers, const rtc_config_t &config);
+
+    // @return false if empty or created for other servers or config
+    bool Take(const ice_servers_t &servers,
+            const rtc_config_t &config,
+            talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> &pc_factory,
+            ubase::zeroptr<RTCPeerConnection> &pc);
+
+    // for talk_base::MessageHandler
+    virtual void OnMessage(talk_base::Message *msg);
+
+private:
+    enum {
+        MSG_REFILL,
+    };
+
+    typedef struct _pooled_pc {
+        talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory;
+        ubase::zeroptr<RTCPeerConnection> pc;
+    }pooled_pc_t;
+
+    static bool IsSameServers(const ice_servers_t &servers1, const ice_servers_t &servers2);
+    static bool IsSameConfig(const rtc_config_t &config1, const rtc_config_t &config2);
+    void Clear();
+
+    talk_base::Thread m_thread;
+    bool m_started;
+    int m_size;
+    ice_servers_t m_servers;
+    rtc_config_t m_config;
+    int m_generation;       // increased when the config changes
+    talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> m_pc_factory; // only in m_thread
+    std::deque<pooled_pc_t> m_pcs;
+    ubase::Mutex m_mutex;
+};
+
+} // namespace xrtc
+
+#endif // _POOL_H_
@@ -25,7 +25,9 @@
 #include "xrtc_std.h"
 #include "webrtc.h"
 #include "constraints.h"
+#include "device.h"
 #include "ubase/error.h"
+#include "ubase/mutex.h"
 
 namespace xrtc {
 
@@ -35,6 +37,10 @@ private:
     talk_base::scoped_refptr<webrtc::MediaSourceInterface> m_source;
 
     MediaTrackConstraints m_constraints;
+    cricket::VideoFormat m_output_format;
+    int m_adapt_scale;      // percent, the cap by SetAdaptation
+    int m_adapt_fps;
+    ubase::Mutex m_mutex;
 
 public:
 bool Init(
@@ -56,8 +62,8 @@ bool Init(
     if (kind == kAudioKind) {
         if (!m_source.get()) {
             WebrtcMediaConstraints constraints;
-            if (m_constraints.mtype == XRTC_AUDIO && m_constraints.ptr) {
-                audio_constraints_t *audio = (audio_constraints_t *)m_constraints.ptr;
+            const audio_constraints_t *audio = m_constraints.audio();
+            if (audio) {
                 if (audio->aec.valid)
                     constraints.AddItem(webrtc::MediaConstraintsInterface::kEchoCancellation, audio->aec.val, audio->aec.optional);
                 if (audio->agc.valid)
@@ -73,18 +79,18 @@ bool Init(
     }else if (kind == kVideoKind) {
         if (!m_source.get()) {
             std::string vname = "";
-            if (m_constraints.mtype == XRTC_VIDEO && m_constraints.ptr) {
-                video_constraints_t *video = (video_constraints_t *)m_constraints.ptr;
-                if (video && video->device.valid) {
-                    vname = video->device.val.did;
-                }
+            const video_constraints_t *video = m_constraints.video();
+            if (video && video->device.valid) {
+                vname = video->device.val.did;
             }
 
             // if vname empty, select default device
             LOGI("vname="<<vname);
             cricket::VideoCapturer* capturer = OpenVideoCaptureDevice(vname);
             if (capturer) {
-                m_source = pc_factory->CreateVideoSource(capturer, NULL);
+                WebrtcMediaConstraints constraints;
+                SetVideoConstraints(capturer, video, constraints);
+                m_source = pc_factory->CreateVideoSource(capturer, &constraints);
             }
         }
 
@@ -92,14 +98,23 @@ bool Init(
         if (m_source) {
             m_track = pc_factory->CreateVideoTrack(label, (webrtc::VideoSourceInterface *)(m_source.get()));
         }
+
+        // The native format may be above the mandatory maxima if no one is within.
+        if (m_track != NULL && m_constraints.video()) {
+            ubase::ScopedLock lock(m_mutex);
+            ApplyVideoConstraints(m_constraints.video());
+        }
     }
     return (m_track != NULL);
 }
 
-explicit CMediaStreamTrack(const MediaTrackConstraints *constraints)
+// The constraints are moved into the track, no copy.
+explicit CMediaStreamTrack(MediaTrackConstraints *constraints)
 {
+    m_adapt_scale = 100;
+    m_adapt_fps = 0;
     if (constraints) {
-        m_constraints = *constraints;
+        m_constraints.swap(*constraints);
     }
 }
 
@@ -161,14 +176,34 @@ MediaStreamTrackState readyState() {
     return state;
 }
 
+// a copy, since applyConstraints may change them on another thread
 MediaTrackConstraints constraints()
 {
+    ubase::ScopedLock lock(m_mutex);
     return m_constraints;
 }
 
+//
+// For a live video track, the new size and frame rate are applied to
+// the capturer's adapter in place: no new source and no renegotiation.
 void applyConstraints(MediaTrackConstraints &constraints)
 {
+    ubase::ScopedLock lock(m_mutex);
     m_constraints = constraints;
+    if (m_constraints.video()) {
+        ApplyVideoConstraints(m_constraints.video());
+    }
+}
+
+//
+// The cap is kept apart from the constraints, so that either could change
+// without losing the other.
+void SetAdaptation(int scale, int frameRate)
+{
+    ubase::ScopedLock lock(m_mutex);
+    m_adapt_scale = (scale > 0 && scale < 100) ? scale : 100;
+    m_adapt_fps = (frameRate > 0) ? frameRate : 0;
+    ApplyVideoConstraints(m_constraints.video());
 }
 
 //MediaStreamTrack clone()
@@ -178,65 +213,97 @@ void stop()
 {}
 
 
-///
-/// for device
-static cricket::VideoCapturer* OpenVideoCaptureDevice(std::string vid)
+void ApplyVideoConstraints(const video_constraints_t *video)
 {
-    talk_base::scoped_ptr<cricket::DeviceManagerInterface> dev_manager(
-            cricket::DeviceManagerFactory::Create());
-    if (!dev_manager->Init()) {
-        LOGW("fail to init DeviceManager");
-        return NULL;
-    }
+    return_assert(m_track.get() && m_source.get());
+    if (m_track->kind() != kVideoKind)
+        return;
 
-    LOGD("device id="<<vid);
-    cricket::VideoCapturer* capturer = NULL;
+    cricket::VideoCapturer* capturer = ((webrtc::VideoSourceInterface *)m_source.get())->GetVideoCapturer();
+    return_assert(capturer);
 
-#if 0
-    std::vector<cricket::Device> devices;
-    if(!dev_manager->GetVideoCaptureDevices(&devices)) {
-        LOGW("fail to GetVideoCaptureDevices");
-        return NULL;
+    const cricket::VideoFormat *capture = capturer->GetCaptureFormat();
+    if (!capture) {
+        LOGW("capturer not started");
+        return;
     }
 
-    std::vector<cricket::Device>::iterator iter = devices.begin();
-    for (; iter != devices.end(); iter++) {
-        std::string key = (*iter).id;
-        if (!vid.empty() && vid != key) {
-            continue;
-        }
-        capturer = dev_manager->CreateVideoCapturer(*iter);
-        if (capturer != NULL)
-            break;
+    cricket::VideoFormat output;
+    if (!SelectOutputFormat(*capture, video, output)) {
+        LOGW("constraints not satisfied by capture format: "<<capture->ToString());
+        return;
     }
-#else
-    cricket::Device device;
-    if(!dev_manager->GetVideoCaptureDevice(vid, &device)) {
-        LOGW("fail to GetVideoCaptureDevice");
-        return NULL;
+    if (m_adapt_scale < 100) {
+        output.width = (output.width * m_adapt_scale / 100) & ~1;
+        output.height = (output.height * m_adapt_scale / 100) & ~1;
     }
-    capturer = dev_manager->CreateVideoCapturer(device);
-#endif
-
-    // TODO: choose the best format
-    if (capturer) {
-        const std::vector<cricket::VideoFormat>* formats = capturer->GetSupportedFormats();
-        LOGD("supported format size="<<formats->size());
-        for (int k=0; k < formats->size(); k++) {
-            const cricket::VideoFormat & format = (*formats)[k];
-            LOGD("supported format, width="<<format.width<<", height="<<format.height);
-        }
+    if (m_adapt_fps > 0 && m_adapt_fps < cricket::VideoFormat::IntervalToFps(output.interval)) {
+        output.interval = cricket::VideoFormat::FpsToInterval(m_adapt_fps);
+    }
+
+    // Avoid reconfiguring the encoder (and so a keyframe) for nothing.
+    cricket::VideoFormat current = m_output_format;
+    if (current.width == 0 || current.height == 0) {
+        current = *capture;
+        current.fourcc = cricket::FOURCC_ANY;
     }
+    if (output == current) {
+        LOGD("output format unchanged: "<<output.ToString());
+        return;
+    }
+
+    LOGI("output format: "<<current.ToString()<<" -> "<<output.ToString());
+    capturer->video_adapter()->OnOutputFormatRequest(output);
+    m_output_format = output;
+}
+
+///
+/// for device
+static cricket::VideoCapturer* OpenVideoCaptureDevice(std::string vid)
+{
+    LOGD("device id="<<vid);
+    cricket::VideoCapturer* capturer = CDeviceRegistry::Instance()->CreateVideoCapturer(vid);
     return capturer;
 }
 
+//
+// Pin the capturer to the best native format, so that webrtc's own
+// selection in VideoSource could not pick a scaled or decoded one.
+static void SetVideoConstraints(
+        cricket::VideoCapturer* capturer, 
+        const video_constraints_t *video, 
+        WebrtcMediaConstraints &constraints)
+{
+    const std::vector<cricket::VideoFormat>* formats = capturer->GetSupportedFormats();
+    cricket::VideoFormat format;
+    if (formats && SelectCaptureFormat(formats, video, format)) {
+        int fps = cricket::VideoFormat::IntervalToFps(format.interval);
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kMinWidth, format.width);
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kMaxWidth, format.width);
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kMinHeight, format.height);
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kMaxHeight, format.height);
+        constraints.SetMandatory(webrtc::MediaConstraintsInterface::kMaxFrameRate, fps);
+    }else {
+        LOGW("no capture format matched, use webrtc's default");
+    }
+
+    if (!video)
+        return;
+    if (video->noiseReduction.valid)
+        constraints.AddItem(webrtc::MediaConstraintsInterface::kNoiseReduction, video->noiseReduction.val, video->noiseReduction.optional);
+    if (video->leakyBucket.valid)
+        constraints.AddItem(webrtc::MediaConstraintsInterface::kLeakyBucket, video->leakyBucket.val, video->leakyBucket.optional);
+    if (video->temporalLayeredScreencast.valid)
+        constraints.AddItem(webrtc::MediaConstraintsInterface::kTemporalLayeredScreencast, video->temporalLayeredScreencast.val, video->temporalLayeredScreencast.optional);
+}
+
 }; //class CMediaStreamTrack
 
 
 ubase::zeroptr<MediaStreamTrack> CreateMediaStreamTrack(
         media_t mtype,
         const std::string label,
-        const MediaTrackConstraints *constraints,
+        MediaTrackConstraints *constraints,
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory, 
         talk_base::scoped_refptr<webrtc::MediaStreamTrackInterface> ptrack)
 {
@@ -254,6 +321,12 @@ ubase::zeroptr<MediaStreamTrack> CreateMediaStreamTrack(
     return track;
 }
 
+void SetTrackAdaptation(MediaStreamTrackPtr track, int scale, int frameRate)
+{
+    return_assert(track.get());
+    // all tracks are CMediaStreamTrack
+    static_cast<CMediaStreamTrack *>(track.get())->SetAdaptation(scale, frameRate);
+}
 
 } // namespace xrtc
 
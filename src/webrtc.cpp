@@ -1,5 +1,9 @@
 #include "webrtc.h"
+#include "device.h"
+#include "json.h"
+#include "compact.h"
 #include "ubase/error.h"
+#include "ubase/mutex.h"
 
 //
 // Names used for a IceCandidate JSON object.
@@ -15,52 +19,77 @@ const char kSessionDescriptionSdpName[] = "sdp";
 
 namespace xrtc {
     
+void Convert2IceServers(const ice_servers_t &ice_servers, webrtc::PeerConnectionInterface::IceServers &servers)
+{
+    servers.clear();
+    ice_servers_t::const_iterator iter;
+    for (iter = ice_servers.begin(); iter != ice_servers.end(); iter++) {
+        webrtc::PeerConnectionInterface::IceServer server;
+        server.uri = iter->uri;
+        server.username = iter->username;
+        server.password = iter->password;
+        servers.push_back(server);
+    }
+}
+
 bool Convert2Json(const webrtc::SessionDescriptionInterface* description, std::string &json)
 {
     if (!description) return false;
 
-    Json::StyledWriter writer;
-    Json::Value jmessage;
-    jmessage[kSessionDescriptionTypeName] = description->type();
     std::string sdp;
     if (!description->ToString(&sdp)) {
         return false;
     }
-    jmessage[kSessionDescriptionSdpName] = sdp;
-    json = writer.write(jmessage);
+
+    // Reserve for the escaped "\r\n" of each sdp line.
+    json.reserve(sdp.size() + sdp.size() / 16 + 64);
+    CJsonWriter writer(json);
+    writer.BeginObject();
+    writer.AddString(kSessionDescriptionTypeName, description->type());
+    writer.AddString(kSessionDescriptionSdpName, sdp);
+    writer.EndObject();
     return true;
 }
     
 bool Convert2Json(const webrtc::IceCandidateInterface* candidate, std::string &json)
 {
-    if (!candidate) return false;
+    CJsonWriter writer(json);
+    return Convert2Json(candidate, writer);
+}
 
-    Json::StyledWriter writer;
-    Json::Value jmessage;
+bool Convert2Json(const webrtc::IceCandidateInterface* candidate, CJsonWriter &writer)
+{
+    if (!candidate) return false;
 
-    jmessage[kCandidateSdpMidName] = candidate->sdp_mid();
-    jmessage[kCandidateSdpMlineIndexName] = candidate->sdp_mline_index();
     std::string sdp;
     if (!candidate->ToString(&sdp)) {
         return false;
     }
-    jmessage[kCandidateSdpName] = sdp;
-    json = writer.write(jmessage);
+
+    writer.BeginObject();
+    writer.AddString(kCandidateSdpMidName, candidate->sdp_mid());
+    writer.AddInt(kCandidateSdpMlineIndexName, candidate->sdp_mline_index());
+    writer.AddString(kCandidateSdpName, sdp);
+    writer.EndObject();
     return true;
 }
 
 bool Convert2SDP(const std::string &json, webrtc::SessionDescriptionInterface* &description)
 {
-    Json::Reader reader;
-    Json::Value jmessage;
-    if (!reader.parse(json, jmessage)) {
-        return false;
-    }
-
     std::string type;
     std::string sdp;
-    GetStringFromJsonObject(jmessage, kSessionDescriptionTypeName, &type);
-    GetStringFromJsonObject(jmessage, kSessionDescriptionSdpName, &sdp);
+    if (IsCompactSignaling(json.data(), json.size())) {
+        if (!DecodeCompactDescription(json.data(), json.size(), type, sdp)) {
+            return false;
+        }
+    }else {
+        CJsonReader reader;
+        if (!reader.Parse(json)) {
+            return false;
+        }
+        reader.GetString(kSessionDescriptionTypeName, type);
+        reader.GetString(kSessionDescriptionSdpName, sdp);
+    }
     if (type.empty() || sdp.empty()) {
         return false;
     }
@@ -71,9 +100,21 @@ bool Convert2SDP(const std::string &json, webrtc::SessionDescriptionInterface* &
 
 bool Convert2ICE(const std::string &json, webrtc::IceCandidateInterface * &candidate)
 {
-    Json::Reader reader;
-    Json::Value jmessage;
-    if (!reader.parse(json, jmessage)) {
+    return Convert2ICE(json.data(), json.size(), candidate);
+}
+
+bool Convert2ICE(const char *json, size_t len, webrtc::IceCandidateInterface * &candidate)
+{
+    if (IsCompactSignaling(json, len)) {
+        std::vector<compact_candidate_t> candidates;
+        returnb_assert(DecodeCompactCandidates(json, len, candidates));
+        returnb_assert(candidates.size() == 1);
+        candidate = webrtc::CreateIceCandidate(candidates[0].mid, candidates[0].mline, candidates[0].sdp);
+        return true;
+    }
+
+    CJsonReader reader;
+    if (!reader.Parse(json, len)) {
         return false;
     }
 
@@ -82,46 +123,104 @@ bool Convert2ICE(const std::string &json, webrtc::IceCandidateInterface * &candi
     std::string sdp;
 
     bool bret = false;
-    bret = GetStringFromJsonObject(jmessage, kCandidateSdpMidName, &sdp_mid);
+    bret = reader.GetString(kCandidateSdpMidName, sdp_mid);
     returnb_assert(bret);
-    bret = GetStringFromJsonObject(jmessage, kCandidateSdpName, &sdp);
+    bret = reader.GetString(kCandidateSdpName, sdp);
     returnb_assert(bret);
-    bret = GetIntFromJsonObject(jmessage, kCandidateSdpMlineIndexName, &sdp_mlineindex);
+    bret = reader.GetInt(kCandidateSdpMlineIndexName, sdp_mlineindex);
     returnb_assert(bret);
 
     candidate = webrtc::CreateIceCandidate(sdp_mid, sdp_mlineindex, sdp);
     return true;
 }
     
-bool GetDevices(const device_kind_t kind,  devices_t & devices) {
-    talk_base::scoped_ptr<cricket::DeviceManagerInterface> dev_manager(
-            cricket::DeviceManagerFactory::Create());
-    if (!dev_manager->Init()) {
+bool Convert2Compact(const webrtc::SessionDescriptionInterface* description, std::string &data)
+{
+    if (!description) return false;
+
+    std::string sdp;
+    if (!description->ToString(&sdp)) {
         return false;
     }
+    return EncodeCompactDescription(description->type(), sdp, data);
+}
 
-    std::vector<cricket::Device> devs;
-    if (kind == kVideoCapture) {
-        dev_manager->GetVideoCaptureDevices(&devs);
-    }else if (kind == kAudioIn) {
-        dev_manager->GetAudioInputDevices(&devs);
-    }else if (kind == kAudioOut) {
-        dev_manager->GetAudioOutputDevices(&devs);
-    }else {
+bool Convert2Compact(const webrtc::IceCandidateInterface* candidate, std::string &data)
+{
+    if (!candidate) return false;
+
+    std::string sdp;
+    if (!candidate->ToString(&sdp)) {
         return false;
     }
+    return EncodeCompactCandidate(candidate->sdp_mid(), candidate->sdp_mline_index(), sdp, data);
+}
 
-    device_t dev;
-    dev.kind = kind;
-    std::vector<cricket::Device>::iterator iter;
-    for (iter=devs.begin(); iter != devs.end(); ++iter) {
-        dev.did = (*iter).id;
-        dev.name = (*iter).name;
-        devices.push_back(dev);
+bool AppendCompact(const webrtc::IceCandidateInterface* candidate, std::string &records)
+{
+    if (!candidate) return false;
+
+    std::string sdp;
+    if (!candidate->ToString(&sdp)) {
+        return false;
     }
-    devs.clear();
+    return AppendCompactCandidate(candidate->sdp_mid(), candidate->sdp_mline_index(), sdp, records);
+}
 
-    return true;
+bool GetDevices(const device_kind_t kind,  devices_t & devices) {
+    return CDeviceRegistry::Instance()->GetDevices(kind, devices);
+}
+
+static ubase::Mutex _factory_mutex;
+static talk_base::Thread *_signaling_thread = NULL;
+static talk_base::Thread *_worker_thread = NULL;
+
+// The threads are started at first use.
+static void GetFactoryThreads(talk_base::Thread * &signaling_thread, talk_base::Thread * &worker_thread)
+{
+    ubase::ScopedLock lock(_factory_mutex);
+    if (!_worker_thread) {
+        _signaling_thread = new talk_base::Thread();
+        _signaling_thread->Start();
+        _worker_thread = new talk_base::Thread();
+        _worker_thread->Start();
+    }
+    signaling_thread = _signaling_thread;
+    worker_thread = _worker_thread;
+}
+
+talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreatePeerConnectionFactory()
+{
+    talk_base::Thread *signaling_thread = NULL;
+    talk_base::Thread *worker_thread = NULL;
+    GetFactoryThreads(signaling_thread, worker_thread);
+    return webrtc::CreatePeerConnectionFactory(worker_thread, signaling_thread, NULL, NULL, NULL);
+}
+
+talk_base::Thread * GetWorkerThread()
+{
+    talk_base::Thread *signaling_thread = NULL;
+    talk_base::Thread *worker_thread = NULL;
+    GetFactoryThreads(signaling_thread, worker_thread);
+    return worker_thread;
+}
+
+void CleanupPeerConnectionFactory()
+{
+    talk_base::Thread *threads[2] = {NULL, NULL};
+    {
+        ubase::ScopedLock lock(_factory_mutex);
+        threads[0] = _signaling_thread;
+        threads[1] = _worker_thread;
+        _signaling_thread = _worker_thread = NULL;
+    }
+
+    for (int k=0; k < 2; k++) {
+        if (threads[k]) {
+            threads[k]->Stop();
+            delete threads[k];
+        }
+    }
 }
 
 } //namespace xrtc
@@ -20,15 +20,42 @@
 
 namespace xrtc {
 
+class CJsonWriter;
+
 bool GetDevices(const device_kind_t kind,  devices_t & devices);
 
+// The factories share the signaling and worker threads of xrtc, so that the worker
+//  thread is known to the port allocators without looking into a factory. The
+//  threads are stopped by CleanupPeerConnectionFactory after all factories are gone.
+talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> CreatePeerConnectionFactory();
+talk_base::Thread * GetWorkerThread();
+void CleanupPeerConnectionFactory();
+
 void GetUserMedia(
         const MediaStreamConstraints & constraints, 
         NavigatorUserMediaCallback *sink,
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory);
+void CancelUserMedia(NavigatorUserMediaCallback *sink);
+void CleanupUserMedia();
+
+bool SelectCaptureFormat(
+        const std::vector<cricket::VideoFormat> *formats, 
+        const video_constraints_t *constraints, 
+        cricket::VideoFormat &best);
+// The output format of capturer by downscaling and frame dropping.
+bool SelectOutputFormat(
+        const cricket::VideoFormat &capture, 
+        const video_constraints_t *constraints, 
+        cricket::VideoFormat &output);
+
+// Codec order, profile-level-id, bandwidth and rtcp-fb in place, without sdp text.
+void ApplySdpPolicy(const sdp_policy_t &policy, cricket::SessionDescription *sdesc);
+
+void Convert2IceServers(const ice_servers_t &ice_servers, webrtc::PeerConnectionInterface::IceServers &servers);
 
 ubase::zeroptr<RTCPeerConnection> CreatePeerConnection(
         webrtc::PeerConnectionInterface::IceServers servers,
+        const rtc_config_t &config,
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory);
 
 ubase::zeroptr<MediaStream> CreateMediaStream(
@@ -36,16 +63,28 @@ ubase::zeroptr<MediaStream> CreateMediaStream(
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory, 
         talk_base::scoped_refptr<webrtc::MediaStreamInterface> pstream);
 
+// @param constraints: moved into the track and left empty if not NULL
 ubase::zeroptr<MediaStreamTrack> CreateMediaStreamTrack(
         media_t mtype,
         const std::string label,
-        const MediaTrackConstraints *constraints,
+        MediaTrackConstraints *constraints,
         talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory, 
         talk_base::scoped_refptr<webrtc::MediaStreamTrackInterface> ptrack);
 
+// Cap the output of a local video track on top of its own constraints, e.g. for cpu
+//  adaptation: scale in percent of the output by the constraints, frameRate 0 for no cap.
+void SetTrackAdaptation(MediaStreamTrackPtr track, int scale, int frameRate);
+
 bool Convert2Json(const webrtc::SessionDescriptionInterface* description, std::string &json);
 bool Convert2Json(const webrtc::IceCandidateInterface* candidate, std::string &json);
+bool Convert2Json(const webrtc::IceCandidateInterface* candidate, CJsonWriter &writer);
 bool Convert2ICE(const std::string &json, webrtc::IceCandidateInterface* &candidate);
+bool Convert2ICE(const char *json, size_t len, webrtc::IceCandidateInterface* &candidate);
+
+// For compact binary signaling, which Convert2SDP/Convert2ICE also accept.
+bool Convert2Compact(const webrtc::SessionDescriptionInterface* description, std::string &data);
+bool Convert2Compact(const webrtc::IceCandidateInterface* candidate, std::string &data);
+bool AppendCompact(const webrtc::IceCandidateInterface* candidate, std::string &records);
 bool Convert2SDP(const std::string &json, webrtc::SessionDescriptionInterface* &description);
     
 } //namespace xrtc
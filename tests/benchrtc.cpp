@@ -0,0 +1,548 @@
+//
+// Benchmark of signaling message conversion (and h264 encoding if WEBRTC_H264),
+//  with checks of the compact round trip and the candidate pool of a peer connection
+//  on loopback, e.g.
+//  $> benchrtc [iterations]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "webrtc.h"
+#include "json.h"
+#include "compact.h"
+#include "allocator.h"
+#include "constraints.h"
+#include "ubase/mutex.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+
+#ifdef WEBRTC_H264
+#include "webrtc/common_video/interface/i420_video_frame.h"
+#include "webrtc/modules/video_coding/codecs/h264/include/h264.h"
+#endif
+
+static const int kDefaultIterations = 20000;
+static const int kCandidatesPerCall = 32;
+static const int kMediaSections = 12;
+
+// The previous json path with DOM and pretty-printing, as baseline.
+static bool StyledConvert2Json(const webrtc::IceCandidateInterface* candidate, std::string &json)
+{
+    Json::StyledWriter writer;
+    Json::Value jmessage;
+    jmessage["sdpMid"] = candidate->sdp_mid();
+    jmessage["sdpMLineIndex"] = candidate->sdp_mline_index();
+    std::string sdp;
+    if (!candidate->ToString(&sdp)) {
+        return false;
+    }
+    jmessage["candidate"] = sdp;
+    json = writer.write(jmessage);
+    return true;
+}
+
+static void CreateCandidates(std::vector<webrtc::IceCandidateInterface *> &candidates)
+{
+    char sdp[256];
+    for (int k=0; k < kCandidatesPerCall; k++) {
+        const char *type = (k % 4 == 3) ? "relay" : ((k % 4 == 2) ? "srflx" : "host");
+        snprintf(sdp, sizeof(sdp), 
+                "candidate:%d %d udp %u 192.168.%d.%d %d typ %s generation 0",
+                1000 + k, 1 + k % 2, 2122260223u - k, k / 8, 10 + k, 50000 + k, type);
+        webrtc::IceCandidateInterface *candidate = webrtc::CreateIceCandidate((k % 2) ? "video" : "audio", k % 2, sdp);
+        if (candidate)
+            candidates.push_back(candidate);
+    }
+}
+
+typedef bool (*candidate_converter_t)(const webrtc::IceCandidateInterface*, std::string &);
+
+static void BenchCandidates(const char *name, candidate_converter_t converter, 
+        const std::vector<webrtc::IceCandidateInterface *> &candidates, int iterations)
+{
+    std::string json;
+    size_t bytes = 0;
+    int count = 0;
+    uint64 start = talk_base::TimeNanos();
+    for (int i=0; i < iterations; i++) {
+        for (size_t k=0; k < candidates.size(); k++) {
+            if (converter(candidates[k], json)) {
+                bytes += json.size();
+                count++;
+            }
+        }
+    }
+    uint64 elapsed = talk_base::TimeNanos() - start;
+    if (count == 0 || elapsed == 0)
+        return;
+
+    double seconds = (double)elapsed / talk_base::kNumNanosecsPerSec;
+    printf("%-24s %12.0f candidates/sec %8.1f bytes/message\n", 
+            name, count / seconds, (double)bytes / count);
+}
+
+// A large offer of many m-lines, e.g. for multi-party calls
+static void CreateLargeSdp(std::string &sdp)
+{
+    char line[256];
+    sdp = "v=0\r\no=- 4327261771880257373 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n";
+    sdp += "a=group:BUNDLE";
+    for (int m=0; m < kMediaSections; m++) {
+        snprintf(line, sizeof(line), " m%d", m);
+        sdp += line;
+    }
+    sdp += "\r\n";
+    for (int m=0; m < kMediaSections; m++) {
+        bool audio = (m % 2 == 0);
+        snprintf(line, sizeof(line), "m=%s 1 RTP/SAVPF %s\r\nc=IN IP4 0.0.0.0\r\na=rtcp:1 IN IP4 0.0.0.0\r\n",
+                audio ? "audio" : "video", audio ? "111 103 104 0 8 106 105 13 126" : "100 116 117");
+        sdp += line;
+        snprintf(line, sizeof(line), "a=ice-ufrag:%08x\r\na=ice-pwd:%08x%08x%08x\r\na=mid:m%d\r\na=sendrecv\r\na=rtcp-mux\r\n", 
+                m, m * 7, m * 13, m * 17, m);
+        sdp += line;
+        sdp += "a=crypto:1 AES_CM_128_HMAC_SHA1_80 inline:KHHsGyZ2y1KRtHVHyYrcmK7hSwbbWSmiS/OM4Ksx\r\n";
+        for (int k=0; k < 8; k++) {
+            snprintf(line, sizeof(line), "a=rtpmap:%d %s/%d\r\na=rtcp-fb:%d nack\r\n", 
+                    100 + k, audio ? "opus" : "VP8", audio ? 48000 : 90000, 100 + k);
+            sdp += line;
+        }
+        for (int k=0; k < 4; k++) {
+            snprintf(line, sizeof(line), "a=ssrc:%u cname:Xq2t9tZkLfnQ8WUg\r\na=ssrc:%u msid:stream%d track%d\r\n", 
+                    1000000u + m * 10 + k, 1000000u + m * 10 + k, m, k);
+            sdp += line;
+        }
+    }
+}
+
+// The previous parsing path with DOM, as baseline.
+static bool DomParseSdp(const std::string &json, std::string &type, std::string &sdp)
+{
+    Json::Reader reader;
+    Json::Value jmessage;
+    if (!reader.parse(json, jmessage)) {
+        return false;
+    }
+    GetStringFromJsonObject(jmessage, "type", &type);
+    GetStringFromJsonObject(jmessage, "sdp", &sdp);
+    return !type.empty() && !sdp.empty();
+}
+
+static bool ViewParseSdp(const std::string &json, std::string &type, std::string &sdp)
+{
+    xrtc::CJsonReader reader;
+    if (!reader.Parse(json)) {
+        return false;
+    }
+    reader.GetString("type", type);
+    reader.GetString("sdp", sdp);
+    return !type.empty() && !sdp.empty();
+}
+
+static bool CompactParseSdp(const std::string &data, std::string &type, std::string &sdp)
+{
+    return xrtc::DecodeCompactDescription(data.data(), data.size(), type, sdp);
+}
+
+typedef bool (*sdp_parser_t)(const std::string &, std::string &, std::string &);
+
+static void BenchSdpParse(const char *name, sdp_parser_t parser, const std::string &json, int iterations)
+{
+    std::string type, sdp;
+    int count = 0;
+    uint64 start = talk_base::TimeNanos();
+    for (int i=0; i < iterations; i++) {
+        if (parser(json, type, sdp))
+            count++;
+    }
+    uint64 elapsed = talk_base::TimeNanos() - start;
+    if (count == 0 || elapsed == 0)
+        return;
+
+    double seconds = (double)elapsed / talk_base::kNumNanosecsPerSec;
+    printf("%-24s %12.0f messages/sec %8.1f MB/sec\n", 
+            name, count / seconds, (double)json.size() * count / seconds / (1024 * 1024));
+}
+
+// A bundled offer of audio and video, each with its own credentials.
+static void CreateBundleSdp(std::string &sdp)
+{
+    sdp = "v=0\r\no=- 4327261771880257373 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+        "a=group:BUNDLE audio video\r\n"
+        "m=audio 1 RTP/SAVPF 111\r\nc=IN IP4 0.0.0.0\r\na=rtcp:1 IN IP4 0.0.0.0\r\n"
+        "a=ice-ufrag:aaaaaaaaaaaaaaaa\r\na=ice-pwd:aaaaaaaaaaaaaaaaaaaaaaaa\r\n"
+        "a=mid:audio\r\na=sendrecv\r\na=rtcp-mux\r\n"
+        "a=crypto:1 AES_CM_128_HMAC_SHA1_80 inline:KHHsGyZ2y1KRtHVHyYrcmK7hSwbbWSmiS/OM4Ksx\r\n"
+        "a=rtpmap:111 opus/48000/2\r\n"
+        "m=video 1 RTP/SAVPF 100\r\nc=IN IP4 0.0.0.0\r\na=rtcp:1 IN IP4 0.0.0.0\r\n"
+        "a=ice-ufrag:vvvvvvvvvvvvvvvv\r\na=ice-pwd:vvvvvvvvvvvvvvvvvvvvvvvv\r\n"
+        "a=mid:video\r\na=sendrecv\r\na=rtcp-mux\r\n"
+        "a=crypto:1 AES_CM_128_HMAC_SHA1_80 inline:KHHsGyZ2y1KRtHVHyYrcmK7hSwbbWSmiS/OM4Ksx\r\n"
+        "a=rtpmap:100 VP8/90000\r\n";
+}
+
+static bool CheckCompactDescription(const std::string &type, const std::string &sdp)
+{
+    std::string data, rtype, rsdp;
+    return xrtc::EncodeCompactDescription(type, sdp, data) &&
+        xrtc::DecodeCompactDescription(data.data(), data.size(), rtype, rsdp) &&
+        rtype == type && rsdp == sdp;
+}
+
+static bool CheckCompactCandidate(const std::string &mid, int mline, const std::string &sdp)
+{
+    std::string data;
+    std::vector<xrtc::compact_candidate_t> items;
+    return xrtc::EncodeCompactCandidate(mid, mline, sdp, data) &&
+        xrtc::DecodeCompactCandidates(data.data(), data.size(), items) &&
+        items.size() == 1 && items[0].mid == mid && items[0].mline == mline && items[0].sdp == sdp;
+}
+
+// decode(encode(x)) == x for descriptions and candidates, in each form of the encoding.
+static bool CheckCompactRoundTrip()
+{
+    static const char * const kCandidates[] = {
+        "candidate:4234997325 1 udp 2043278322 192.168.0.56 44323 typ host generation 0",
+        "candidate:1 2 tcp 1518280447 10.0.0.1 9 typ host tcptype active generation 0",
+        "candidate:842163049 1 udp 1677729535 1.2.3.4 50000 typ srflx raddr 10.0.0.1 rport 50000 generation 0",
+        "candidate:3 1 ssltcp 16777215 fe80::1 443 typ relay raddr 0.0.0.0 rport 0",
+        "candidate:4 1 udp 100 1.2.3.4 5 typ host",
+        "candidate:5 01 udp 100 1.2.3.4 5 typ host",          // literal: not the same when re-rendered
+        "candidate:6 1 udp 100 1.2.3.4 5 typ private",        // literal word of type
+        "candidate:7 1 udp",                                  // literal: too few fields
+        "a=candidate:8",                                      // literal: no prefix
+        "",
+    };
+    static const int kMlines[] = {0, 1, 127, 128, INT_MAX};
+
+    int failed = 0;
+    std::string sdp;
+    CreateLargeSdp(sdp);
+    failed += !CheckCompactDescription("offer", sdp);
+    CreateBundleSdp(sdp);
+    failed += !CheckCompactDescription("answer", sdp);
+    failed += !CheckCompactDescription("pranswer", sdp + "a=x-unknown:1\r\na=mid:\r\n");
+    failed += !CheckCompactDescription("rollback", "");                 // literal type
+    failed += !CheckCompactDescription("offer", "v=0\r\ns=-");          // raw: no last CRLF
+    failed += !CheckCompactDescription("offer", "v=0\ns=-\n");          // raw: LF only
+
+    std::string records;
+    int count = 0;
+    for (size_t k=0; k < sizeof(kCandidates) / sizeof(kCandidates[0]); k++) {
+        for (size_t m=0; m < sizeof(kMlines) / sizeof(kMlines[0]); m++) {
+            failed += !CheckCompactCandidate((m % 2) ? "video" : "", kMlines[m], kCandidates[k]);
+        }
+        if (xrtc::AppendCompactCandidate("audio", (int)k, kCandidates[k], records))
+            count++;
+    }
+
+    std::string data;
+    std::vector<xrtc::compact_candidate_t> items;
+    xrtc::EncodeCompactCandidates(records, count, data);
+    if (!xrtc::DecodeCompactCandidates(data.data(), data.size(), items) || (int)items.size() != count) {
+        failed++;
+    }else {
+        for (size_t k=0; k < items.size(); k++)
+            failed += (items[k].mid != "audio" || items[k].mline != (int)k || items[k].sdp != kCandidates[k]);
+    }
+
+    // a negative mline is not encoded, and one out of int is not decoded
+    failed += CheckCompactCandidate("audio", -1, kCandidates[0]);
+    xrtc::EncodeCompactCandidate("a", INT_MAX, kCandidates[0], data);
+    size_t pos = data.find("\xff\xff\xff\xff\x07");
+    if (pos == std::string::npos) {
+        failed++;
+    }else {
+        data[pos + 4] = 0x0f;
+        failed += xrtc::DecodeCompactCandidates(data.data(), data.size(), items);
+    }
+
+    printf("compact: round trip of descriptions and candidates: %s\n", failed ? "FAIL" : "OK");
+    return failed == 0;
+}
+
+static const int kPoolSize = 2;
+static const int kPoolWaitMs = 5000;
+static const int kPollMs = 10;
+
+// The offer and trickled candidates of a peer connection, which come on the signaling thread.
+class CPoolObserver : public webrtc::PeerConnectionObserver, 
+    public webrtc::CreateSessionDescriptionObserver, 
+    public webrtc::SetSessionDescriptionObserver {
+public:
+    CPoolObserver() : m_offer(NULL), m_failed(false), m_set(false) {}
+    virtual ~CPoolObserver() { delete m_offer; }
+
+    // for webrtc::PeerConnectionObserver
+    virtual void OnError() {}
+    virtual void OnStateChange(webrtc::PeerConnectionObserver::StateType state_changed) {}
+    virtual void OnAddStream(webrtc::MediaStreamInterface* stream) {}
+    virtual void OnRemoveStream(webrtc::MediaStreamInterface* stream) {}
+    virtual void OnDataChannel(webrtc::DataChannelInterface* data_channel) {}
+    virtual void OnRenegotiationNeeded() {}
+    virtual void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) {
+        std::string sdp;
+        if (candidate && candidate->ToString(&sdp)) {
+            ubase::ScopedLock lock(m_mutex);
+            m_trickled.push_back(sdp);
+        }
+    }
+
+    // for webrtc::CreateSessionDescriptionObserver and SetSessionDescriptionObserver
+    virtual void OnSuccess(webrtc::SessionDescriptionInterface* desc) {
+        ubase::ScopedLock lock(m_mutex);
+        m_offer = desc;
+    }
+    virtual void OnSuccess() {
+        ubase::ScopedLock lock(m_mutex);
+        m_set = true;
+    }
+    virtual void OnFailure(const std::string& error) {
+        printf("pool: %s\n", error.c_str());
+        ubase::ScopedLock lock(m_mutex);
+        m_failed = true;
+    }
+
+    webrtc::SessionDescriptionInterface *TakeOffer() {
+        ubase::ScopedLock lock(m_mutex);
+        webrtc::SessionDescriptionInterface *offer = m_offer;
+        m_offer = NULL;
+        return offer;
+    }
+    bool IsFailed() { ubase::ScopedLock lock(m_mutex); return m_failed; }
+    bool IsSet() { ubase::ScopedLock lock(m_mutex); return m_set; }
+    std::vector<std::string> GetTrickled() { ubase::ScopedLock lock(m_mutex); return m_trickled; }
+
+private:
+    webrtc::SessionDescriptionInterface *m_offer;
+    bool m_failed;
+    bool m_set;
+    std::vector<std::string> m_trickled;
+    ubase::Mutex m_mutex;
+};
+
+// The pool gathers host candidates on loopback before the first local description of
+//  a real peer connection, which takes them at once with the pooled credentials shared
+//  by the bundled contents. Then its channels take the pooled sessions, and trickle
+//  none of the attached candidates again.
+static bool CheckCandidatePool()
+{
+    talk_base::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory = xrtc::CreatePeerConnectionFactory();
+    if (!pc_factory.get()) {
+        printf("pool: fail to create peer connection factory\n");
+        return false;
+    }
+
+    rtc_config_t config;
+    config.ice_candidate_pool_size = kPoolSize;
+    config.ice_transport_policy = kIceTransportHost;
+    config.network_allowlist.push_back("lo");
+    talk_base::scoped_refptr<xrtc::CPortAllocatorFactory> factory = xrtc::CPortAllocatorFactory::Create(xrtc::GetWorkerThread(), config);
+    talk_base::scoped_refptr<talk_base::RefCountedObject<CPoolObserver> > observer = 
+        new talk_base::RefCountedObject<CPoolObserver>();
+    webrtc::PeerConnectionInterface::IceServers servers;
+    talk_base::scoped_refptr<webrtc::PeerConnectionInterface> conn = pc_factory->CreatePeerConnection(
+            servers, NULL, factory.get(), NULL, observer.get());
+    if (!factory.get() || !conn.get()) {
+        printf("pool: fail to create peer connection\n");
+        return false;
+    }
+
+    size_t pooled = 0, taken = 0;
+    uint32 deadline = talk_base::Time() + kPoolWaitMs;
+    do {
+        talk_base::Thread::SleepMs(kPollMs);
+        factory->GetPoolStats(pooled, taken);
+    } while (pooled == 0 && talk_base::TimeIsLater(talk_base::Time(), deadline));
+
+    xrtc::WebrtcMediaConstraints constraints;
+    constraints.SetMandatory(webrtc::MediaConstraintsInterface::kOfferToReceiveAudio, true);
+    constraints.SetMandatory(webrtc::MediaConstraintsInterface::kOfferToReceiveVideo, true);
+    conn->CreateOffer(observer.get(), &constraints);
+    webrtc::SessionDescriptionInterface *offer = NULL;
+    while (!(offer = observer->TakeOffer()) && !observer->IsFailed() && 
+            talk_base::TimeIsLater(talk_base::Time(), deadline)) {
+        talk_base::Thread::SleepMs(kPollMs);
+    }
+    if (!offer) {
+        printf("pool: no offer\n");
+        return false;
+    }
+
+    // as CRTCPeerConnectionObserver for the created offer
+    const cricket::SessionDescription *sdesc = offer->description();
+    const cricket::TransportInfo *audio = sdesc->GetTransportInfoByName("audio");
+    const cricket::TransportInfo *video = sdesc->GetTransportInfoByName("video");
+    std::string ufrag = audio ? audio->description.ice_ufrag : "";
+    uint64 start = talk_base::TimeNanos();
+    factory->OnLocalDescription(offer, true);
+    uint64 elapsed = talk_base::TimeNanos() - start;
+
+    std::vector<std::string> attached;
+    const webrtc::IceCandidateCollection *collection = offer->candidates(0);
+    for (size_t k=0; collection && k < collection->count(); k++) {
+        std::string sdp;
+        if (collection->at(k)->ToString(&sdp))
+            attached.push_back(sdp);
+    }
+    bool pooled_ufrag = (audio && audio->description.ice_ufrag != ufrag);
+    bool bundled = (audio && video && audio->description.ice_ufrag == video->description.ice_ufrag &&
+            audio->description.ice_pwd == video->description.ice_pwd);
+
+    // the channels are created and take the pooled sessions
+    conn->SetLocalDescription(observer.get(), offer);
+    while ((!observer->IsSet() || conn->ice_gathering_state() != webrtc::PeerConnectionInterface::kIceGatheringComplete) &&
+            !observer->IsFailed() && talk_base::TimeIsLater(talk_base::Time(), deadline)) {
+        talk_base::Thread::SleepMs(kPollMs);
+    }
+    factory->GetPoolStats(pooled, taken);
+
+    std::vector<std::string> trickled = observer->GetTrickled();
+    int replayed = 0;
+    for (size_t k=0; k < trickled.size(); k++) {
+        if (std::find(attached.begin(), attached.end(), trickled[k]) != attached.end())
+            replayed++;
+    }
+    conn->Close();
+
+    bool ok = observer->IsSet() && pooled_ufrag && bundled && !attached.empty() && taken > 0 && replayed == 0;
+    printf("pool: %d loopback candidates attached in %.1f us, pooled=%d, bundled=%d, "
+            "taken=%d, trickled=%d, replayed=%d: %s\n",
+            (int)attached.size(), (double)elapsed / talk_base::kNumNanosecsPerMicrosec, pooled_ufrag, bundled, 
+            (int)taken, (int)trickled.size(), replayed, ok ? "OK" : "FAIL");
+    return ok;
+}
+
+#ifdef WEBRTC_H264
+static const int kEncodeFrames = 300;
+static const int kSourceFrames = 10;
+
+class CEncodedCounter : public webrtc::EncodedImageCallback {
+public:
+    CEncodedCounter() : frames(0), bytes(0) {}
+    virtual int32_t Encoded(webrtc::EncodedImage& encoded_image,
+            const webrtc::CodecSpecificInfo* codec_specific_info,
+            const webrtc::RTPFragmentationHeader* fragmentation) {
+        frames++;
+        bytes += encoded_image._length;
+        return 0;
+    }
+    int frames;
+    size_t bytes;
+};
+
+// Moving gradient with noise, which is not too easy for the encoder.
+static void CreateSourceFrames(int width, int height, std::vector<webrtc::I420VideoFrame *> &frames)
+{
+    unsigned int seed = 1;
+    int half_width = (width + 1) / 2;
+    int half_height = (height + 1) / 2;
+    for (int k=0; k < kSourceFrames; k++) {
+        webrtc::I420VideoFrame *frame = new webrtc::I420VideoFrame();
+        frame->CreateEmptyFrame(width, height, width, half_width, half_width);
+        uint8_t *y = frame->buffer(webrtc::kYPlane);
+        for (int j=0; j < height; j++) {
+            for (int i=0; i < width; i++) {
+                seed = seed * 1103515245 + 12345;
+                y[j * width + i] = (uint8_t)((i + j + k * 8) + ((seed >> 16) & 0x0f));
+            }
+        }
+        memset(frame->buffer(webrtc::kUPlane), 128 + k, half_width * half_height);
+        memset(frame->buffer(webrtc::kVPlane), 128 - k, half_width * half_height);
+        frames.push_back(frame);
+    }
+}
+
+static void BenchH264Encode(int width, int height, int threads)
+{
+    webrtc::VideoCodec codec;
+    memset(&codec, 0, sizeof(codec));
+    codec.codecType = webrtc::kVideoCodecH264;
+    codec.width = width;
+    codec.height = height;
+    codec.maxFramerate = 30;
+    codec.startBitrate = width * height * 30 / 1000 / 10;
+    codec.maxBitrate = codec.startBitrate;
+
+    std::vector<webrtc::I420VideoFrame *> frames;
+    CreateSourceFrames(width, height, frames);
+
+    CEncodedCounter counter;
+    webrtc::H264Encoder *encoder = webrtc::H264Encoder::Create();
+    encoder->RegisterEncodeCompleteCallback(&counter);
+    if (encoder->InitEncode(&codec, threads, 1200) == WEBRTC_VIDEO_CODEC_OK) {
+        uint64 start = talk_base::TimeNanos();
+        for (int k=0; k < kEncodeFrames; k++) {
+            webrtc::I420VideoFrame *frame = frames[k % frames.size()];
+            frame->set_timestamp(k * 3000);
+            encoder->Encode(*frame, NULL, NULL);
+        }
+        uint64 elapsed = talk_base::TimeNanos() - start;
+        if (counter.frames > 0 && elapsed > 0) {
+            double seconds = (double)elapsed / talk_base::kNumNanosecsPerSec;
+            printf("H264 %4dx%-4d %d threads %8.1f frames/sec %8.2f Mbps\n",
+                    width, height, threads, kEncodeFrames / seconds,
+                    counter.bytes * 8.0 / counter.frames * 30 / (1000 * 1000));
+        }
+    }
+    encoder->Release();
+    delete encoder;
+
+    for (size_t k=0; k < frames.size(); k++)
+        delete frames[k];
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : kDefaultIterations;
+    if (iterations <= 0)
+        iterations = kDefaultIterations;
+
+    std::vector<webrtc::IceCandidateInterface *> candidates;
+    CreateCandidates(candidates);
+    printf("candidates: %d x %d iterations\n", (int)candidates.size(), iterations);
+
+    BenchCandidates("StyledWriter", StyledConvert2Json, candidates, iterations);
+    BenchCandidates("CJsonWriter", xrtc::Convert2Json, candidates, iterations);
+    BenchCandidates("Compact", xrtc::Convert2Compact, candidates, iterations);
+
+    for (size_t k=0; k < candidates.size(); k++)
+        delete candidates[k];
+
+    std::string sdp, json;
+    CreateLargeSdp(sdp);
+    xrtc::CJsonWriter writer(json);
+    writer.BeginObject();
+    writer.AddString("type", "offer");
+    writer.AddString("sdp", sdp);
+    writer.EndObject();
+    printf("sdp: %d m-lines, %d bytes of json x %d iterations\n", kMediaSections, (int)json.size(), iterations / 10);
+
+    BenchSdpParse("Json::Reader", DomParseSdp, json, iterations / 10);
+    BenchSdpParse("CJsonReader", ViewParseSdp, json, iterations / 10);
+
+    std::string compact;
+    xrtc::EncodeCompactDescription("offer", sdp, compact);
+    printf("sdp: %d bytes of compact\n", (int)compact.size());
+    BenchSdpParse("Compact", CompactParseSdp, compact, iterations / 10);
+
+    bool compact_ok = CheckCompactRoundTrip();
+    bool pool_ok = CheckCandidatePool();
+
+#ifdef WEBRTC_H264
+    static const int kThreads[] = {1, 2, 4, 8};
+    printf("h264: %d frames at 30fps\n", kEncodeFrames);
+    for (size_t k=0; k < sizeof(kThreads) / sizeof(kThreads[0]); k++)
+        BenchH264Encode(1280, 720, kThreads[k]);
+    for (size_t k=0; k < sizeof(kThreads) / sizeof(kThreads[0]); k++)
+        BenchH264Encode(1920, 1080, kThreads[k]);
+#endif
+    xrtc::CleanupPeerConnectionFactory();
+    return (compact_ok && pool_ok) ? 0 : 1;
+}